@@ -0,0 +1,39 @@
+/**
+ * @author:MgJun
+ * @brief:线程绑核和 NUMA 拓扑的辅助函数。
+ * 绑定用的 CPU 用字符串配置：空串表示不绑定，"0-3,8" 为 CPU 列表，"node:1" 为 1 号 NUMA 节点上的所有 CPU。
+ * 没有引入 libnuma，内存的本地性靠 Linux 默认的首次访问策略：线程先绑到某个节点的核上，之后它第一次写入的页就分配在这个节点。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+class Affinity{
+public:
+    //解析绑定配置，格式不对的部分忽略
+    static std::vector<int> Parse(const std::string& spec);
+
+    //cpu 所在的 NUMA 节点，没有 NUMA 信息时返回 -1
+    static int NodeOf(int cpu);
+    //节点上的所有 CPU
+    static std::vector<int> NodeCpus(int node);
+
+    //把线程绑定到 cpus 中的任一 CPU 上，cpus 为空时不做任何事
+    static bool Pin(pthread_t thread, const std::vector<int>& cpus);
+    static bool PinSelf(const std::vector<int>& cpus) { return Pin(pthread_self(), cpus); }
+
+    //写日志用，格式同 Parse 接受的 CPU 列表
+    static std::string ToString(const std::vector<int>& cpus);
+
+private:
+    static std::vector<int> ParseList_(const char* list);
+};
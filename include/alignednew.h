@@ -0,0 +1,36 @@
+/**
+ * @author:MgJun
+ * @brief:按缓存行对齐分配对象。
+ * C++14 的 new 只保证 alignof(std::max_align_t) 对齐，带 alignas(64) 成员的类型用普通 new 分配时起始地址不一定在缓存行边界上，
+ * 为避免伪共享加的填充就不可靠，GCC 也会给出 -Waligned-new 警告。
+ * 继承 CacheAligned 的类型由 posix_memalign 分配，new / delete 的写法不变。
+ * 注意 make_shared 不会用到类里的 operator new，这类对象要用 shared_ptr<T>(new T(...)) 创建。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <new>
+#include <stdlib.h>
+
+struct CacheAligned{
+    static const size_t CACHE_LINE = 64;
+
+    static void* operator new(size_t size){
+        void* mem = nullptr;
+        if(posix_memalign(&mem, CACHE_LINE, size) != 0) throw std::bad_alloc();
+        return mem;
+    }
+
+    static void* operator new[](size_t size){
+        return operator new(size);
+    }
+
+    static void operator delete(void* mem) noexcept{
+        free(mem);
+    }
+
+    static void operator delete[](void* mem) noexcept{
+        free(mem);
+    }
+};
@@ -17,6 +17,8 @@ BlockDeque 是基于 std::deque 实现的，使用 std::mutex 和 std::condition
 向队列首部插入元素，如果队列已满则阻塞等待。
 从队列中取出首部元素并删除，如果队列为空则阻塞等待。
 从队列中取出首部元素并删除，如果队列为空则等待指定时间后返回。如果等待超时则返回 false。如果队列已关闭则返回 false。
+入队支持移动和原地构造，出队时元素移动给调用方，不再拷贝。
+pop_all / try_pop_n 在一次加锁中取走全部或最多 n 个元素，消费者可以成批处理。
  * @date 23/3/13
 */
 
@@ -24,6 +26,9 @@ BlockDeque 是基于 std::deque 实现的，使用 std::mutex 和 std::condition
 
 #include <mutex>
 #include <deque>
+#include <algorithm>
+#include <vector>
+#include <utility>
 #include <condition_variable>
 #include <sys/time.h>
 
@@ -53,12 +58,23 @@ public:
 
     void push_back(const T& item);
 
+    void push_back(T&& item);
+
+    template<class... Args>
+    void emplace_back(Args&&... args);
+
     void push_front(const T& item);
 
     bool pop(T& item);
 
     bool pop(T& item, int timeout);
 
+    //队列为空时等待，之后一次取走全部元素追加到 items；队列关闭时返回 false
+    bool pop_all(std::vector<T>& items);
+
+    //不等待，最多取走 n 个元素追加到 items，返回取走的个数
+    size_t try_pop_n(std::vector<T>& items, size_t n);
+
     void flush();   
 
 private:
@@ -141,11 +157,22 @@ size_t BlockDeque<T>::capacity(){
 如果队列为空，则线程被阻塞等待元素的到来。当消费者线程从队列中取出一个元素后，需要通过调用condProducer_.notify_one()来通知一个（或所有）等待的生产者线程可以开始生产元素。*/
 template<class T>
 void BlockDeque<T>::push_back(const T& item){
+    emplace_back(item);
+};
+
+template<class T>
+void BlockDeque<T>::push_back(T&& item){
+    emplace_back(std::move(item));
+};
+
+template<class T>
+template<class... Args>
+void BlockDeque<T>::emplace_back(Args&&... args){
     std::unique_lock<std::mutex> locker(mtx_);
     while(deq_.size() >= capacity_){
         condProducer_.wait(locker);
     }
-    deq_.push_back(item);
+    deq_.emplace_back(std::forward<Args>(args)...);
     condConsumer_.notify_one();
 };
 
@@ -155,7 +182,7 @@ void BlockDeque<T>::push_front(const T& item){
     while(deq_.size() >= capacity_){
         condProducer_.wait(locker);
     }
-    deq_.push_front();
+    deq_.push_front(item);
     condConsumer_.notify_one();
 };
 
@@ -180,7 +207,7 @@ bool BlockDeque<T>::pop(T& item){
             return false;
         }
     }
-    item = deq_.front();
+    item = std::move(deq_.front());
     deq_.pop_front();
     condProducer_.notify_one();
     return true;
@@ -197,11 +224,43 @@ bool BlockDeque<T>::pop(T& item, int timeout){
         if(isClose_){
             return false;
         }
-        item = deq_.front();
+    }
+    item = std::move(deq_.front());
+    deq_.pop_front();
+    condProducer_.notify_one();
+    return true;
+}
+
+template<class T>
+bool BlockDeque<T>::pop_all(std::vector<T>& items){
+    std::unique_lock<std::mutex> locker(mtx_);
+    while(deq_.empty()){
+        condConsumer_.wait(locker);
+        if(isClose_){
+            return false;
+        }
+    }
+    items.reserve(items.size() + deq_.size());
+    for(T& item : deq_){
+        items.push_back(std::move(item));
+    }
+    deq_.clear();
+    condProducer_.notify_all();     //腾出了不止一个位置
+    return true;
+}
+
+template<class T>
+size_t BlockDeque<T>::try_pop_n(std::vector<T>& items, size_t n){
+    std::lock_guard<std::mutex> locker(mtx_);
+    size_t count = std::min(n, deq_.size());
+    for(size_t i = 0; i < count; i++){
+        items.push_back(std::move(deq_.front()));
         deq_.pop_front();
-        condProducer_.notify_one();
-        return true;
     }
+    if(count > 0){
+        condProducer_.notify_all();
+    }
+    return count;
 }
 /*
 在 push_back() 和 push_front() 方法中使用 unique_lock 是为了在生产者尝试向队列中添加元素时能够对队列进行条件变量等待，
@@ -7,21 +7,34 @@
 在 C++ 的 STL 库中，vector 容器其实就很适合作为缓冲区。为了能够满足我们的需要，我们以 vector 容器作为底层实体，在它的上面封装自己所需要的方法来实现一个自己的 buffer 缓冲区，
     满足读写的需要。
 
+
+存储改为从 BufferPool 借来的内存块（见 bufferpool.h），析构时归还；扩容按两倍增长并向上取到池的等级，不再按缺多少补多少。
+缓冲区拥有自己的内存块，不能拷贝。
+RetrieveAll() 只重置读写位置，不再清零整块内存。
+连接的读写已经改用 ChainBuffer 和 OutputQueue，空闲收缩策略也随之放在 ChainBuffer 上。
 */
 
 #pragma once
 #include <iostream>
 #include <vector>
 #include <string>
-#include <atomic>
 #include <unistd.h> //read(),write()
 #include <sys/uio.h> //readv(),readv()
 #include <assert.h>
 #include <cstring>
+
+#include "bufferpool.h"
+
 class Buffer{
 public:
     Buffer(int initBufferSize = 1024);
-    ~Buffer() = default;
+    ~Buffer();
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    //当前容量
+    size_t Capacity() const { return capacity_; }
+
     //缓存区中可写字节数
     size_t WriteableBytes() const;
     //缓存区中可读的字节数
@@ -43,7 +56,7 @@ public:
     void RetrieveUntil(const char* end);
 
 
-    //初始化清空buffer
+    //初始化清空buffer，O(1)
     void RetrieveAll() ;
     //将缓冲区的数据转化为字符串
     std::string RetrieveAllToStr();
@@ -70,19 +83,24 @@ public:
     //test
     void printContent(){
         std::cout<<"pointer location info:"<<readPos_<<" "<<writePos_<<std::endl;
-        for(int i = readPos_; i <= writePos_; ++i){
+        for(size_t i = readPos_; i < writePos_; ++i){
             std::cout<<buffer_[i]<<std::endl;
         }
         std::cout<<std::endl;
     }
 private:
 
-    std::vector<char> buffer_; //缓冲区
-    std::atomic<std::size_t> readPos_; //用于指示读指针
-    std::atomic<std::size_t> writePos_; //用于指示写指针
+    char* buffer_;     //缓冲区，从 BufferPool 借来的块
+    size_t capacity_;  //块的实际大小
+    //缓冲区只属于一个连接（或在锁内使用），同一时刻只有一个线程访问，读写位置用普通整数，
+    //不必为每次 Peek()、ReadableBytes()、HasWritten() 付出原子操作的代价
+    std::size_t readPos_; //用于指示读指针
+    std::size_t writePos_; //用于指示写指针
     //返回指向缓冲区初始位置的指针
     char* BeginPtr_();
     const char* BeginPtr_() const;
     //扩容
     void MakeSpace_(size_t len);
+    //换一块至少 capacity 字节的块，可读数据挪到新块开头
+    void Reallocate_(size_t capacity);
 };
\ No newline at end of file
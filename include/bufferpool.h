@@ -0,0 +1,47 @@
+/**
+ * @author:MgJun
+ * @brief:Buffer 使用的分级内存池。
+ * 按 2K、8K、32K、128K 四个等级分配内存块，申请的大小向上取到最近的等级；每个线程为每个等级保存一条空闲链表，
+ * 归还的块挂回当前线程的链表，下次同一等级的申请直接取走，连接反复建立、缓冲区反复扩容时不再调用 malloc。
+ * 每条链表有长度上限，超出的块直接释放，避免只归还不申请的线程囤积内存；线程退出时链表上的块一并释放。
+ * 超过最大等级的申请不走链表，直接 malloc / free。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <stdlib.h>
+#include <assert.h>
+
+class BufferPool{
+public:
+    //申请至少 *size 字节的块，*size 改为块的实际大小
+    static char* Alloc(size_t* size);
+    //size 必须是 Alloc 返回的实际大小
+    static void Free(char* block, size_t size);
+
+    //size 向上取整后的块大小
+    static size_t RoundUp(size_t size);
+
+    static const int CLASS_COUNT = 4;
+    static const size_t CLASS_SIZE[CLASS_COUNT];
+    static const size_t MAX_FREE_BLOCKS = 64;  //每个线程每个等级最多缓存的空闲块
+
+private:
+    struct Node{ Node* next; };
+    //链表本身是平凡类型，线程退出时由 Releaser 释放上面的块；
+    //之后（例如静态对象析构时）再归还的块直接 free
+    struct FreeList{
+        Node* head;
+        size_t count;
+    };
+    struct Releaser{
+        ~Releaser();
+    };
+
+    static int ClassOf_(size_t size);
+    static FreeList* Lists_();
+
+    static thread_local FreeList lists_[CLASS_COUNT];
+    static thread_local bool released_;
+};
@@ -0,0 +1,106 @@
+/**
+ * @author:MgJun
+ * @brief:由内存池块串成的链式缓冲区。
+ * Buffer 是一整块连续内存，放不下时要么整体换块拷贝，要么把未读数据挪到开头；readFd 还要先读进栈上的数组再 Append 一次。
+ * ChainBuffer 把数据放在一串从 BufferPool 借来的块里：readFd 用 readv 直接读进链尾的空闲空间和新块，写出时把整条链转成 iovec 交给 writev，
+ * 读完的块立即还回内存池，数据从套接字到解析器之间不会被拷贝两次。
+ * 解析器通过 Peek() / PeekEnd() 直接读第一块；只有一行跨越了块边界时，才用 Pullup() 把这一行拼到一块里。
+ * 每次 readv 新借的块按连接最近的请求大小自适应：大多数请求不到 1K，只借 2K 的块；上一次读把给出的空间全部读满时，
+ * 说明还有大量数据（比如上传），先用 FIONREAD 查询内核中待读的字节数，按它借块，减少 readv 的次数。
+ * 超出新块的部分先落到线程共享的溢出区再追加进链，溢出区取代了原来每次 readFd 都要占用的 64K 栈数组。
+ * 链被读空时保留最后一块给下一次 readFd 用；这一块如果是为大请求借的大块，在之后连续 idleMs 内都没再用到
+ * 超过 keepBytes 的空间时还回内存池，收缩策略由 SetShrinkPolicy() 统一配置。连接一直没有新请求时，
+ * 由事件循环定期调用 ReleaseIdle() 做同样的检查。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <deque>
+#include <atomic>
+#include <string>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <assert.h>
+#include <cstring>
+
+#include "bufferpool.h"
+#include "coarseclock.h"
+
+class ChainBuffer{
+public:
+    explicit ChainBuffer(size_t blockSize = 2 * 1024);
+    ~ChainBuffer();
+    ChainBuffer(const ChainBuffer&) = delete;
+    ChainBuffer& operator=(const ChainBuffer&) = delete;
+
+    //读空后留下的块超过 keepBytes 且空闲 idleMs 后归还；idleMs 为负数时不收缩
+    static void SetShrinkPolicy(size_t keepBytes, int idleMs);
+
+    //整条链上可读的字节数
+    size_t ReadableBytes() const { return readable_; }
+
+    //第一块中可读数据的起止位置
+    const char* Peek() const;
+    const char* PeekEnd() const;
+
+    //保证前 len 个字节在第一块中连续，len 不能超过 ReadableBytes()
+    void Pullup(size_t len);
+
+    //从 Peek() 开始找 "\r\n"，找到时把这一行（含 "\r\n"）拼到第一块中并返回 "\r\n" 的位置，找不到返回 nullptr
+    const char* FindCRLF();
+
+    void Retrieve(size_t len);
+    void RetrieveUntil(const char* end);
+    //清空，只保留一块备用
+    void RetrieveAll();
+    //清空并把所有块还回内存池
+    void Shrink();
+    //连接空闲时定期调用：链已经读空时，按收缩策略决定留下的那一块是否归还
+    void ReleaseIdle();
+
+    void Append(const char* data, size_t len);
+    void Append(const std::string& str) { Append(str.data(), str.size()); }
+
+    //直接读进链尾，空间不够时链上新块
+    ssize_t readFd(int fd, int* saveErrno);
+
+    //解析完一个请求后告知它的大小，用来估计下次 readFd 借多大的块
+    void NoteMessageSize(size_t size);
+    size_t ReadHint() const { return readHint_; }
+
+    //把可读数据按顺序填进 iov，最多 max 个，返回填了几个
+    int FillIovec(struct iovec* iov, int max) const;
+    //writev 整条链，写出的部分从链上移除
+    ssize_t writeFd(int fd, int* saveErrno);
+
+private:
+    struct Block{
+        char* data;
+        size_t cap;
+        size_t read;
+        size_t write;
+    };
+
+    Block NewBlock_(size_t size);
+    void FreeBlock_(Block& block);
+
+    size_t ReadSize_(int fd);
+    void ReleaseIdle_();    //唯一的一块刚被读空，按收缩策略决定留下还是归还
+
+    std::deque<Block> blocks_;
+    size_t readable_;
+    size_t blockSize_;      //Append 时新块的最小大小
+    size_t readHint_;       //最近请求大小的滑动平均
+    bool lastReadFull_;     //上一次 readFd 是否把给出的空间读满了
+    long long bigUsedMs_;   //最近一次用到超过 keepBytes 空间的时间
+
+    static std::atomic<size_t> keepBytes_;
+    static std::atomic<int> idleMs_;
+
+    static const int MAX_READ_IOV = 3;
+    static const size_t OVERFLOW_SIZE = 64 * 1024;
+    static const int MAX_WRITE_IOV = 16;
+};
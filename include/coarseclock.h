@@ -0,0 +1,79 @@
+/**
+ * @author:MgJun
+ * @brief:粗粒度的时钟服务。
+ * 事件循环每轮调用一次 Update()，读一次实时时钟和单调时钟，把 HTTP 的 Date 头、日志的时间前缀格式化好缓存起来，
+ * 其他线程读取时只做一次拷贝：每个请求发 Date 头、每条日志打时间戳、定时器取当前时间，都不再需要系统调用和格式化。
+ * 事件循环可能长时间睡在 epoll_wait 里，读者先读一次单调时钟（vDSO，不进内核），缓存超过 1 毫秒就自己刷新，时间不会停住。
+ * 缓存的内容用顺序锁（seqlock）保护，读者不加锁，读到写了一半的数据时重读；
+ * 内容按 8 字节一组存成原子变量，读写同时发生时也不构成数据竞争。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <time.h>
+#include <string.h>
+#include <stdint.h>
+
+class CoarseClock{
+public:
+    static CoarseClock* Instance();
+
+    //事件循环每轮调用一次
+    void Update();
+
+    //单调时间，给定时器使用
+    std::chrono::steady_clock::time_point Now();
+    long long NowMs();
+
+    //"Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"，buf 至少 DATE_HEADER_LEN 字节，返回长度
+    size_t DateHeader(char* buf);
+
+    //"2023-03-27 12:00:00.123456 "，buf 至少 LOG_TIME_LEN 字节，返回长度；mday 返回当天是几号
+    size_t LogTime(char* buf, int* mday);
+
+    //把时间格式化成 HTTP-date，如 "Sun, 06 Nov 1994 08:49:37 GMT"
+    static std::string FormatHttpDate(time_t t);
+
+    static const size_t DATE_HEADER_LEN = 40;
+    static const size_t LOG_TIME_LEN = 32;
+
+private:
+    CoarseClock();
+    ~CoarseClock() = default;
+
+    void Update_();
+    void RefreshIfStale_();
+
+    static const long long MAX_AGE_NS = 1000000;    //缓存最多用 1 毫秒
+    static const size_t DATE_WORDS = DATE_HEADER_LEN / 8;
+    static const size_t LOG_TIME_WORDS = LOG_TIME_LEN / 8;
+    static_assert(DATE_HEADER_LEN % 8 == 0 && LOG_TIME_LEN % 8 == 0, "cached strings are published in 8-byte words");
+
+    static long long MonoNs_();
+    static void Publish_(std::atomic<uint64_t>* words, const char* src, size_t count);
+    static void Load_(const std::atomic<uint64_t>* words, char* dst, size_t count);
+
+    std::atomic<long long> monoNs_;
+
+    //以下内容受 seq_ 保护，seq_ 为奇数时表示正在写
+    std::atomic<unsigned> seq_;
+    std::atomic<uint64_t> date_[DATE_WORDS];
+    std::atomic<size_t> dateLen_;
+    std::atomic<uint64_t> logTime_[LOG_TIME_WORDS];
+    std::atomic<size_t> logTimeLen_;
+    std::atomic<int> mday_;
+
+    //写者私有，受 writeMtx_ 保护：同一秒内只改写微秒数字，要留着上次格式化的结果
+    std::mutex writeMtx_;   //同一时刻只允许一个写者
+    time_t sec_;
+    char dateBuf_[DATE_HEADER_LEN];
+    size_t dateBufLen_;
+    char logTimeBuf_[LOG_TIME_LEN];
+    size_t logTimeBufLen_;
+    int bufMday_;
+};
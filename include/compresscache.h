@@ -0,0 +1,64 @@
+/**
+ * @author:MgJun
+ * @brief:运行时压缩结果的缓存。
+ * 没有预压缩副本的内容（例如以后的动态内容）在工作线程里用 zlib 压缩，
+ * 结果按 (path, version, encoding) 缓存，资源不变时每种编码只压缩一次；version 变化（文件被修改）后旧结果自然失效，由 LRU 淘汰。
+ * 多个线程同时未命中同一个 key 时，只有第一个线程真正压缩，其余线程等待它的结果。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <unordered_map>
+
+#include "log.h"
+#include "contentcoding.h"
+
+class CompressCache{
+public:
+    using Result = std::shared_ptr<const std::string>;
+    //未命中时调用，负责把压缩结果写入 out，失败返回 false
+    using Compressor = std::function<bool(std::string& out)>;
+
+    static CompressCache* Instance();
+
+    void Init(int level = Z_DEFAULT_COMPRESSION, size_t minSize = 1024, size_t maxBytes = 64 * 1024 * 1024);
+
+    //大小达到阈值且类型可压缩才值得压缩
+    bool ShouldCompress(const std::string& path, size_t len) const;
+
+    int GetLevel() const { return level_; }
+
+    //命中直接返回缓存，未命中调用 compress 生成并缓存；失败返回 nullptr
+    Result Get(const std::string& path, const std::string& version,
+                ContentCoding::CODING coding, const Compressor& compress);
+
+    void Clear();
+
+private:
+    CompressCache();
+    ~CompressCache() = default;
+
+    struct Entry{
+        std::shared_future<Result> result;
+        size_t bytes;       //压缩完成前为 0
+        std::list<std::string>::iterator lru;
+    };
+
+    void Evict_();
+
+    int level_;
+    size_t minSize_;
+    size_t maxBytes_;
+    size_t totalBytes_;
+
+    std::unordered_map<std::string, Entry> cache_;
+    std::list<std::string> lru_;    //表头是最近使用的 key
+    std::mutex mtx_;
+};
@@ -0,0 +1,62 @@
+/**
+ * @author:MgJun
+ * @brief:内容编码（Content-Encoding）相关的工具。
+ * 静态资源可以在旁边放一个预压缩好的副本（foo.css.gz / foo.css.br），响应时根据客户端的 Accept-Encoding（带 q 值）挑选一个编码，
+ * 直接 mmap 压缩后的文件发送，这样压缩只做一次，发送仍然走零拷贝的路径。
+ * PrecompressDir() 用于启动时离线生成 .gz 副本；.br 副本需要用 brotli 命令行工具预先生成，存在时同样会被使用。
+ * 没有副本的内容由 Compress() 在运行时用 zlib 压缩成 gzip 或 deflate，结果缓存在 CompressCache 中。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <string>
+#include <stdlib.h>     //strtof
+#include <strings.h>    //strncasecmp
+#include <zlib.h>
+#include <dirent.h>     //opendir, readdir
+#include <fcntl.h>      //open
+#include <unistd.h>     //close
+#include <sys/stat.h>   //stat
+#include <sys/mman.h>   //mmap, munmap
+#include <string.h>     //strlen, strncmp, strstr
+
+#include "log.h"
+#include "mimetype.h"
+
+class ContentCoding{
+public:
+    enum CODING{
+        IDENTITY = 0,
+        GZIP,
+        DEFLATE,        //只做运行时压缩，没有预压缩副本
+        BR,
+        CODING_COUNT,
+    };
+
+    //在 available（按位表示 1 << CODING）中选出客户端最想要的编码，q 值相同时按 br > gzip > deflate 的顺序
+    static CODING Negotiate(const std::string& acceptEncoding, unsigned available);
+
+    //Content-Encoding 中使用的名字
+    static const char* Name(CODING coding);
+    //预压缩副本的后缀，IDENTITY 为空串，没有副本的编码为 nullptr
+    static const char* Suffix(CODING coding);
+
+    //按后缀对应的 MIME 类型判断是否值得压缩：文本、+xml / +json、javascript、wasm 以及未压缩的字体和图标，
+    //图片、视频、woff 等本身已压缩的格式和不认识的后缀都不处理
+    static bool IsCompressible(const std::string& path);
+
+    //用 zlib 把 data 压缩成 gzip 或 deflate（zlib 格式）写入 out，level 越高越省带宽、越费 CPU
+    static bool Compress(const char* data, size_t len, CODING coding, int level, std::string& out);
+
+    //把 src 压缩成 gzip 格式写到 dst，先写临时文件再 rename，保证并发读到的一定是完整文件
+    static bool GzipFile(const std::string& src, const std::string& dst, int level = Z_BEST_COMPRESSION);
+
+    //递归遍历 dir，为缺失或过期的可压缩文件生成 .gz 副本，返回生成的文件数
+    static int PrecompressDir(const std::string& dir, int level = Z_BEST_COMPRESSION);
+
+private:
+    static const char* NAME[CODING_COUNT];
+    static const char* SUFFIX[CODING_COUNT];
+    static const char* COMPRESSIBLE_TYPE[];
+};
@@ -0,0 +1,58 @@
+/**
+ * @author:MgJun
+ * @brief:启动时预制好的错误响应。
+ * 每个错误状态码（400、403、404、405、503）的响应在 Init() 时一次生成：正文取自 resources 下对应的错误页，文件不存在时按原来的格式生成；
+ * 响应头按 Connection 的两种取值、正文按可用的编码（原文、gzip、deflate）各生成一份，之后只读。
+ * 发送时响应头一次写进输出队列，只在 Date 的位置填上当前时间；正文不拷贝，由输出队列直接引用这里的内存。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "outputqueue.h"
+#include "coarseclock.h"
+#include "contentcoding.h"
+#include "compresscache.h"
+
+class ErrorPage{
+public:
+    struct Page{
+        std::string header[2];  //[isKeepAlive]，到 Date 之前为止，Date 和结尾的空行发送时补上
+        std::string body;       //已按对应编码压缩好的正文
+    };
+
+    static ErrorPage* Instance();
+
+    //在服务线程启动前调用一次，srcDir 为资源目录
+    void Init(const std::string& srcDir);
+
+    //按 Accept-Encoding 选出错误页；没有预制的状态码按 400 处理，code 改为实际发送的状态码
+    const Page& Get(int* code, const std::string& acceptEncoding) const;
+
+    //把响应头（含当前 Date 和结尾空行）一次写入 out
+    static void AppendHeader(const Page& page, bool isKeepAlive, OutputQueue& out);
+
+private:
+    ErrorPage() = default;
+    ~ErrorPage() = default;
+
+    static std::string ReadFile_(const std::string& path);
+    static std::string Generate_(int code, const std::string& status, const std::string& message);
+
+    struct Entry{
+        unsigned codings;   //这个状态码的错误页可用的编码
+        Page pages[ContentCoding::CODING_COUNT];
+    };
+    std::unordered_map<int, Entry> entries_;
+
+    static const unsigned ON_THE_FLY_CODINGS;
+    static const std::unordered_map<int, std::string> CODE_STATUS;
+    static const std::unordered_map<int, std::string> CODE_PATH;
+};
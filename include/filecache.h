@@ -0,0 +1,103 @@
+/**
+ * @author:MgJun
+ * @brief:静态资源的元数据缓存。
+ * 每个资源第一次被请求时 stat 原文件和预压缩副本，解析好 MIME 类型，并把 200 响应中不随请求变化的部分
+ * （状态行、Content-type、Content-length、Last-Modified、ETag、Content-Encoding、Vary）按编码各拼成一个现成的响应头块。
+ * 之后的请求只需要把头块整体 Append 进写缓冲区，再补上 Connection、Date 等逐请求的部分，生成 200 响应头不再有堆分配。
+ * 条目每隔 checkIntervalMs 重新 stat 一次，文件变化后整体重建。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <sys/stat.h>
+#include <unordered_map>
+
+#include "contentcoding.h"
+#include "compresscache.h"
+#include "coarseclock.h"
+#include "resourcebundle.h"
+#include "mimetype.h"
+
+class FileEntry{
+public:
+    FileEntry(const std::string& srcDir, const std::string& path, const struct stat& st);
+
+    const std::string& SrcDir() const { return srcDir_; }
+    const std::string& Path() const { return path_; }
+
+    //可以发送的编码（按位表示），IDENTITY 总是可用
+    unsigned Codings() const { return codings_; }
+    //响应内容是否随 Accept-Encoding 变化
+    bool Varies() const { return codings_ != (1u << ContentCoding::IDENTITY); }
+
+    //coding 对应要映射的文件（原文件或预压缩副本）及其 stat，运行时压缩的编码没有文件
+    const std::string& File(ContentCoding::CODING coding) const { return file_[coding]; }
+    const struct stat& Stat(ContentCoding::CODING coding) const { return stat_[coding]; }
+    //文件已预加载进 ResourceBundle 且内容一致时返回内存中的地址，否则返回 nullptr
+    const char* Bundled(ContentCoding::CODING coding) const { return bundled_[coding]; }
+
+    //运行时压缩的结果，第一次调用时压缩并缓存在条目里；失败或该编码有文件时返回 nullptr
+    CompressCache::Result Encoded(ContentCoding::CODING coding) const;
+
+    //预先拼好的响应头块，不含 Connection、Date 和结尾的空行；运行时压缩失败时返回空串
+    const std::string& Header(ContentCoding::CODING coding) const;
+
+    //HEAD 请求用的头块，不会触发运行时压缩：运行时压缩的编码还没有结果时不带 Content-length，其余和 Header 相同
+    const std::string& HeadHeader(ContentCoding::CODING coding) const;
+
+    //文件和副本是否都没有变化
+    bool IsFresh() const;
+
+    mutable std::atomic<long long> checkedMs;  //上次确认新鲜的时间
+
+private:
+    //len 小于 0 时不写 Content-length
+    std::string MakeHeader_(ContentCoding::CODING coding, long long len) const;
+
+    std::string srcDir_;
+    std::string path_;
+    const char* mime_;     //建立条目时按后缀查一次
+    std::string lastModified_;
+    std::string etag_;
+
+    unsigned codings_;
+    std::string file_[ContentCoding::CODING_COUNT];
+    struct stat stat_[ContentCoding::CODING_COUNT];
+    const char* bundled_[ContentCoding::CODING_COUNT];
+
+    //运行时压缩的编码在第一次使用时才生成结果和头块
+    mutable std::once_flag once_[ContentCoding::CODING_COUNT];
+    mutable CompressCache::Result encoded_[ContentCoding::CODING_COUNT];
+    mutable std::string header_[ContentCoding::CODING_COUNT];
+    mutable std::atomic<bool> built_[ContentCoding::CODING_COUNT];    //header_ 已经生成
+    std::string headHeader_[ContentCoding::CODING_COUNT];              //运行时压缩的编码在生成之前给 HEAD 用
+};
+
+class FileCache{
+public:
+    using EntryPtr = std::shared_ptr<const FileEntry>;
+
+    static FileCache* Instance();
+
+    void Init(int checkIntervalMs = 1000);
+
+    //code 返回 200、403 或 404，只有 200 时返回非空的条目
+    EntryPtr Get(const std::string& srcDir, const std::string& path, int* code);
+
+    void Clear();
+
+private:
+    FileCache();
+    ~FileCache() = default;
+
+    EntryPtr Load_(const std::string& srcDir, const std::string& path, int* code);
+
+    int checkIntervalMs_;
+    std::unordered_map<std::string, EntryPtr> cache_;
+    std::mutex mtx_;
+};
@@ -33,14 +33,15 @@
 #include <arpa/inet.h>
 
 #include "log.h"
+#include "coarseclock.h"
 
 /*这段代码定义了几个类型和函数对象：
     TimeoutCallBack 是一个函数对象类型，表示定时器超时时需要执行的回调函数。
-    Clock 是 std::chrono 库中的高精度时钟类型，用于获取时间戳。
+    Clock 是 std::chrono 库中的单调时钟类型，当前时间从 CoarseClock 取，事件循环每轮只读一次时钟。
     MS 是 std::chrono 库中的毫秒类型。
     TimeStamp 是 Clock::time_point 类型的别名，表示一个时间点。*/
 using TimeoutCallBack = std::function<void()>;
-using Clock = std::chrono::high_resolution_clock;
+using Clock = std::chrono::steady_clock;
 using MS = std::chrono::milliseconds;
 using TimeStamp = Clock::time_point;
 
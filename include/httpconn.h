@@ -18,7 +18,8 @@
 #include "httpresponse.h"
 #include "sqlconnRAII.h"
 #include "log.h"
-#include "buffer.h"
+#include "chainbuffer.h"
+#include "outputqueue.h"
 
 
 class HttpConn{
@@ -39,8 +40,25 @@ public:
 
     bool process();
 
-    int ToWriteBytes(){ //需要写入的字节数
-        return iov_[0].iov_len + iov_[1].iov_len;
+    //读到的请求可能阻塞在数据库上，应该放到阻塞任务的线程池处理
+    bool MayBlock() const{
+        return HttpRequest::MayBlock(readBuff_.Peek(), readBuff_.PeekEnd());
+    }
+
+    //线程池过载时由事件循环调用：读掉已到达的请求，直接回一个 503（Connection: close），之后由调用方关闭连接
+    void Shed();
+
+    //处理零拷贝的完成通知；返回 false 表示这次 EPOLLERR 是真正的连接错误
+    bool ReapZeroCopy();
+
+    //事件循环把这个连接交给线程池前调用 BeginTask，任务结束时调用 EndTask；计数不为 0 时事件循环不碰缓冲区
+    void BeginTask(){ tasks_.fetch_add(1, std::memory_order_relaxed); }
+    void EndTask(){ tasks_.fetch_sub(1, std::memory_order_release); }
+    //事件循环定期调用：没有任务在处理这个连接时，按收缩策略归还空闲的读缓冲；已关闭的连接归还全部缓冲
+    void ReleaseIdle();
+
+    size_t ToWriteBytes() const{ //需要写入的字节数
+        return output_.Bytes();
     }
 
     bool isKeepAlive() const{
@@ -60,12 +78,11 @@ private:
     struct sockaddr_in addr_;
 
     bool isClosed_;
+    std::atomic<int> tasks_;    //已提交还没结束的读写任务数
 
-    int iovCnt_;
-    struct iovec iov_[2];
 
-    Buffer readBuff_;
-    Buffer writeBuff_;
+    ChainBuffer readBuff_;   //读到的请求直接留在内存池块中由解析器读取
+    OutputQueue output_;     //待发送的响应片段
 
     HttpRequest request_;
     HttpResponse response_;
@@ -12,7 +12,7 @@
 #include <mysql/mysql.h>
 
 #include "log.h"
-#include "buffer.h"
+#include "chainbuffer.h"
 #include "sqlconnRAII.h"
 #include "sqlconnpool.h"
 
@@ -41,7 +41,7 @@ public:
     ~HttpRequest() = default;
 
     void Init();
-    bool parse(Buffer& buff);
+    bool parse(ChainBuffer& buff);
 
     std::string path() const;
     std::string& path();
@@ -49,8 +49,15 @@ public:
     std::string version() const;
     std::string GetPost(const std::string& key) const;
     std::string GetPost(const char* key) const;
+    const std::string& GetHeader(const std::string& key) const;
 
     bool IsKeepAlive() const;
+    bool IsHead() const;
+    //静态资源路径上只支持 GET、HEAD、POST，其余方法（包括 OPTIONS）回复 405
+    bool IsMethodAllowed() const;
+
+    //还没解析时按请求行的开头判断这个请求会不会访问数据库：只有 POST 可能走到 UserVerify
+    static bool MayBlock(const char* begin, const char* end);
 
 private:
 
@@ -9,44 +9,39 @@
 #include <fcntl.h>      //open
 #include <unistd.h>     //closr
 #include <sys/stat.h>   //stat
-#include <sys/mman.h>  //mmap. munmap
 #include <unordered_map>
 
 #include "log.h"
-#include "buffer.h"
+#include "outputqueue.h"
+#include "contentcoding.h"
+#include "compresscache.h"
+#include "filecache.h"
+#include "errorpage.h"
 
 class HttpResponse{
 public:
     HttpResponse();
-    ~HttpResponse();
+    ~HttpResponse() = default;
 
 
     void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
-    void MakeResponse(Buffer& buff);
-    void UnmapFile();
-    char* File();
-    size_t FileLen() const;
-    void ErrorContent(Buffer& buff, std::string message);
+    void SetAcceptEncoding(const std::string& acceptEncoding);
+    void SetHeadOnly(bool headOnly);   //HEAD 请求只发送响应头
+    //把响应的各个部分追加到连接的输出队列
+    void MakeResponse(OutputQueue& out);
     int Code() const { return code_;}
 
 private:
-    void AddStatLine_(Buffer& buff);
-    void AddHeader_(Buffer& buff);
-    void AddContent_(Buffer& buff);
-
-    void ErrorHtml_();
-    std::string GetFileType_();
+    bool AddCachedResponse_(const FileCache::EntryPtr& entry, OutputQueue& out);
+    void AddTail_(OutputQueue& out);
 
     int code_;
     bool isKeepAlive_;
+    bool headOnly_;
 
     std::string path_;
     std::string srcDir_;
 
-    char* mmFile_;
-    struct stat mmFileStat_; //_stat结构体是文件（夹）信息的结构体，定义如下：以上信息就是可以通过_stat函数获取的所有相关信息，一般情况下，我们关心文件大小和创建时间、访问时间、修改时间。
-
-    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
-    static const std::unordered_map<int, std::string> CODE_STATUS;
-    static const std::unordered_map<int, std::string> CODE_PATH;
+    std::string acceptEncoding_;
+    ContentCoding::CODING coding_; //实际发送的编码
 };
\ No newline at end of file
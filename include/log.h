@@ -7,26 +7,47 @@
 #include <string>
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <condition_variable>
 #include <sys/time.h>
 #include <assert.h>
 #include <stdarg.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <stdint.h>
 
-#include "buffer.h"
-#include "blockqueue.h"
+#include "logring.h"
+#include "coarseclock.h"
+#include "affinity.h"
 
 class Log{
 public:
+    /*异步模式下日志什么时候真正写进文件：
+    PER_LINE  每条日志都叫醒写线程立即写出，只用于调试；
+    INTERVAL  每 value 毫秒写一次；
+    SIZE      写线程的缓冲攒够 value 字节再写，最多等 SIZE_MAX_AGE_MS；
+    ON_LEVEL  等级不低于 value 的日志立即写出，其余每 FLUSH_INTERVAL_MS 写一次。
+    同步模式下每条日志都直接写文件，不受影响。*/
+    enum FLUSH_POLICY {PER_LINE, INTERVAL, SIZE, ON_LEVEL};
+
     void init(int level, const char* path = "./log",
                 const char* suffix = ".log",
                 int maxQueueCapacity = 1024);
 
     static Log* Instance();
     static void FlushLogThread();
+    //把异步写线程绑到 cpus 上，同步模式下没有写线程，返回 false
+    bool SetAffinity(const std::vector<int>& cpus);
 
     void write(int level, const char* format, ...);
+    //异步模式下叫醒写线程，把各线程暂存的日志立即写出；同步模式下日志已经写进文件，什么都不做
     void flush();
+    void SetFlushPolicy(FLUSH_POLICY policy, int value);
 
 
     //日志等级
@@ -35,14 +56,28 @@ public:
     bool IsOpen() {return isOpen_;}
 private:
     Log();
-    void AppendLevelTitle_(int level);
     virtual ~Log();
+    size_t Format_(char* dst, size_t size, int level, const char* format, va_list vaList, int* mday);
+    void Rotate_(int mday);         //按日期和行数切换文件，调用方持有 mtx_
+    static int OpenFile_(const char* filename);
+    LogRing* LocalRing_();          //当前线程的暂存环，第一次调用时创建并登记
+    void WakeWriter_();
+    void RequestFlush_();           //要求写线程这一轮就把缓冲写出
+    void Drain_();                  //等写线程把此前写进各个环的日志全部写进文件
     void AsyncWrite_();             //异步写
+    void Collect_();                //把所有环里的数据拷进写线程的缓冲
+    void Flush_();                  //把写线程的缓冲一次 write 出去
+    void WriteAll_(const char* data, size_t len);   //调用方持有 mtx_
 
 private:
     static const int LOG_PATH_LEN = 256;
     static const int LOG_NAME_LEN = 256;
     static const int MAX_LINES = 50000;
+    static const size_t MAX_ENTRY = 4096;           //单条日志的最大长度，超出的部分截断
+    static const size_t RING_SIZE = 64 * 1024;      //每个线程暂存环的大小
+    static const int FLUSH_INTERVAL_MS = 100;       //ON_LEVEL、PER_LINE 下普通日志最多等这么久就会被写出
+    static const int SIZE_MAX_AGE_MS = 1000;        //SIZE 下缓冲里的日志最多等这么久
+    static const size_t OUT_BUFFER_SIZE = 1024 * 1024;  //写线程的输出缓冲
 
     const char* path_;
     const char* suffix_;
@@ -50,18 +85,39 @@ private:
     int MAX_LINES_;
 
     int lineCount_;
+    int fileIndex_;
     int toDay_;
 
     bool isOpen_;
 
-    Buffer buff_;
-    int level_;
+    std::atomic<int> level_;
     bool isAsync_;
 
-    FILE* fp_;
-    std::unique_ptr<BlockDeque<std::string>> deque_;
+    int fd_;
     std::unique_ptr<std::thread> writeThread_;
-    std::mutex mtx_;
+    std::mutex mtx_;                //保护 fd_ 和文件切换
+
+    std::mutex ringsMtx_;
+    std::vector<std::shared_ptr<LogRing>> rings_;   //所有线程的暂存环，线程退出后由写线程取完再移除
+
+    //以下三项只由写线程访问
+    std::unique_ptr<char[]> out_;
+    size_t outLen_;
+    int outLines_;
+
+    std::atomic<int> flushPolicy_;
+    std::atomic<int> flushValue_;
+
+    std::mutex wakeMtx_;
+    std::condition_variable wakeCond_;
+    std::atomic<bool> wakePending_;
+    std::atomic<bool> flushNow_;
+    std::atomic<bool> isClosing_;
+
+    //Drain_ 的请求和完成序号，由 wakeMtx_ 保护
+    std::condition_variable drainCond_;
+    uint64_t drainReq_;
+    uint64_t drainDone_;
 };
 
 #define LOG_BASE(level, format, ...)\
@@ -69,7 +125,6 @@ private:
         Log* log = Log::Instance();\
         if(log->IsOpen() && log->GetLevel() <= level){\
             log->write(level, format, ##__VA_ARGS__);\
-            log->flush();\
         }\
     }while(0);                    //do{} while(0)保证只执行一次并且不用担心分号的问题
 
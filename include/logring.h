@@ -0,0 +1,122 @@
+/**
+ * @author:MgJun
+ * @brief:日志的单生产者单消费者字节环。
+ * 每个写日志的线程独占一个环，把格式化好的日志直接写进环里的空闲空间；唯一的消费者是日志写线程，
+ * 它把环里的可读数据（绕回时是两段）描述成 iovec 取走，再整体前移读位置。
+ * 读写位置都是只增不减的计数，生产者只写 tail_、消费者只写 head_，分别用 release 发布、acquire 读取，不需要锁。
+ * 两个位置各占一个缓存行；生产者缓存一份 head_，只有看起来放不下时才重新读取。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <assert.h>
+
+#include "alignednew.h"
+
+class LogRing : public CacheAligned{
+public:
+    //容量向上取整到 2 的幂
+    explicit LogRing(size_t capacity = 64 * 1024): closed_(false){
+        assert(capacity > 0);
+        capacity_ = 1;
+        while(capacity_ < capacity) capacity_ <<= 1;
+        mask_ = capacity_ - 1;
+        data_ = static_cast<char*>(malloc(capacity_));
+        if(!data_) throw std::bad_alloc();
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+        cachedHead_ = 0;
+    }
+
+    ~LogRing(){ free(data_); }
+
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    /*---------- 生产者 ----------*/
+
+    //取得写位置上至少 len 字节的连续空闲空间，放不下或会跨过环尾时返回 nullptr
+    char* Reserve(size_t len){
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t offset = tail & mask_;
+        if(offset + len > capacity_ || !HasSpace_(tail, len)) return nullptr;
+        return data_ + offset;
+    }
+
+    //发布 Reserve 之后写入的 len 字节
+    void Commit(size_t len){
+        tail_.store(tail_.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    //整体拷贝进环，必要时分两段；空间不够时什么都不写，返回 false
+    bool Append(const char* data, size_t len){
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if(!HasSpace_(tail, len)) return false;
+        size_t offset = tail & mask_;
+        size_t first = capacity_ - offset < len ? capacity_ - offset : len;
+        memcpy(data_ + offset, data, first);
+        memcpy(data_, data + first, len - first);
+        tail_.store(tail + len, std::memory_order_release);
+        return true;
+    }
+
+    //线程退出时调用，之后不会再有写入，消费者取完剩下的数据就可以丢弃这个环
+    void Close(){ closed_.store(true, std::memory_order_release); }
+
+    /*---------- 消费者 ----------*/
+
+    //把可读数据描述成最多两段 iovec，返回字节数；调用方写完后用 Retrieve 归还空间
+    size_t Peek(struct iovec* iov, int* count) const{
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t len = tail_.load(std::memory_order_acquire) - head;
+        *count = 0;
+        if(len == 0) return 0;
+        size_t offset = head & mask_;
+        size_t first = capacity_ - offset < len ? capacity_ - offset : len;
+        iov[0].iov_base = data_ + offset;
+        iov[0].iov_len = first;
+        *count = 1;
+        if(first < len){
+            iov[1].iov_base = data_;
+            iov[1].iov_len = len - first;
+            *count = 2;
+        }
+        return len;
+    }
+
+    void Retrieve(size_t len){
+        head_.store(head_.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    bool IsClosed() const{ return closed_.load(std::memory_order_acquire); }
+
+    /*---------- 两边都可以调用，结果是近似值 ----------*/
+
+    size_t ReadableBytes() const{
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const{ return capacity_; }
+
+private:
+    bool HasSpace_(size_t tail, size_t len){
+        if(tail + len - cachedHead_ <= capacity_) return true;
+        cachedHead_ = head_.load(std::memory_order_acquire);
+        return tail + len - cachedHead_ <= capacity_;
+    }
+
+    char* data_;
+    size_t capacity_;
+    size_t mask_;
+    std::atomic<bool> closed_;
+
+    alignas(CACHE_LINE) std::atomic<size_t> head_;  //只由消费者前移
+    alignas(CACHE_LINE) std::atomic<size_t> tail_;  //只由生产者前移
+    size_t cachedHead_;                              //生产者私有，head_ 的旧值
+};
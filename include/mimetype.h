@@ -0,0 +1,23 @@
+/**
+ * @author:MgJun
+ * @brief:按文件后缀查 MIME 类型。
+ * 后缀到类型的表和它的开放寻址散列表都在编译期生成，查找时从路径末尾取出后缀、转小写、算一次 FNV-1a，
+ * 按散列值直接定位到表项再比较一次后缀，不构造 substr，也不分配内存。
+ * FileEntry 建立时查一次，结果拼进预制的响应头，之后的请求不再查找。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <string>
+#include <string.h>
+#include <stdint.h>
+
+class MimeType{
+public:
+    //path 的后缀对应的 MIME 类型；没有后缀或后缀不认识时返回 text/plain
+    static const char* Of(const char* path, size_t len);
+    //同 Of，但后缀不认识时返回 nullptr，供需要区分“未知类型”的调用方使用
+    static const char* Find(const char* path, size_t len);
+    static const char* Of(const std::string& path) { return Of(path.data(), path.size()); }
+};
@@ -0,0 +1,263 @@
+/**
+ * @author:MgJun
+ * @brief:有界的无锁多生产者多消费者环形队列（Vyukov）。
+ * 每个槽带一个序号，生产者和消费者各自只 CAS 一个位置计数，槽和两个计数各占一个缓存行，互不干扰。
+ * 现在用作线程池的全局注入队列，只用到不阻塞的 try_push / try_pop / try_pop_n；
+ * 日志原本也打算用它，后来改成了每个线程一个 LogRing（见 logring.h），不再经过这个队列。
+ * 另外保留了阻塞的 push_back / pop：pop 只在队列空时通过 futex 睡眠，生产者只在有消费者睡眠时才去唤醒，
+ * 队列满时 push_back 同样用 futex 等待；关闭后 pop 先取完剩下的元素再返回 false。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <utility>
+#include <chrono>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <assert.h>
+
+#include "alignednew.h"
+
+//两个位置计数各占一个缓存行，堆上分配时也要按缓存行对齐
+template<class T>
+class MpmcQueue : public CacheAligned{
+public:
+    //容量向上取整到 2 的幂
+    explicit MpmcQueue(size_t MaxCapacity = 1024): isClose_(false){
+        assert(MaxCapacity > 0);
+        capacity_ = 1;
+        while(capacity_ < MaxCapacity) capacity_ <<= 1;
+        mask_ = capacity_ - 1;
+        void* mem = nullptr;
+        if(posix_memalign(&mem, CACHE_LINE, sizeof(Cell) * capacity_) != 0) throw std::bad_alloc();
+        cells_ = static_cast<Cell*>(mem);
+        for(size_t i = 0; i < capacity_; i++){
+            new (&cells_[i]) Cell();
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        enqueuePos_.store(0, std::memory_order_relaxed);
+        dequeuePos_.store(0, std::memory_order_relaxed);
+        notEmpty_.store(0, std::memory_order_relaxed);
+        notFull_.store(0, std::memory_order_relaxed);
+        consumers_.store(0, std::memory_order_relaxed);
+        producers_.store(0, std::memory_order_relaxed);
+    }
+
+    ~MpmcQueue(){
+        Close();
+        for(size_t i = 0; i < capacity_; i++){
+            cells_[i].~Cell();
+        }
+        free(cells_);
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    //满时返回 false，item 不被移走
+    bool try_push(T&& item){
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while(true){
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if(dif == 0){
+                if(enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if(dif < 0){
+                return false;
+            }
+            else{
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(item);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        Notify_(consumers_, notEmpty_, 1);
+        return true;
+    }
+
+    bool try_push(const T& item){
+        T copy(item);
+        return try_push(std::move(copy));
+    }
+
+    //空时返回 false
+    bool try_pop(T& item){
+        if(!TryPop_(item)) return false;
+        Notify_(producers_, notFull_, 1);
+        return true;
+    }
+
+    //不等待，最多取走 n 个元素追加到 items，返回取走的个数；整批只唤醒一次生产者
+    size_t try_pop_n(std::vector<T>& items, size_t n){
+        size_t count = 0;
+        T item;
+        while(count < n && TryPop_(item)){
+            items.push_back(std::move(item));
+            count++;
+        }
+        if(count > 0) Notify_(producers_, notFull_, static_cast<int>(count));
+        return count;
+    }
+
+    //满时等待；队列关闭后放弃这个元素
+    void push_back(T&& item){
+        if(try_push(std::move(item))) return;
+        Waiter waiter(producers_);
+        while(true){
+            uint32_t seq = notFull_.load(std::memory_order_seq_cst);
+            if(try_push(std::move(item)) || isClose_.load(std::memory_order_acquire)) return;
+            FutexWait_(notFull_, seq, nullptr);
+        }
+    }
+
+    void push_back(const T& item){
+        T copy(item);
+        push_back(std::move(copy));
+    }
+
+    //空时一直等，直到有元素或队列关闭
+    bool pop(T& item){
+        return Pop_(item, -1);
+    }
+
+    //空时最多等 timeout 秒
+    bool pop(T& item, int timeout){
+        return Pop_(item, timeout);
+    }
+
+    //唤醒一个等待的消费者，让它重新检查队列
+    void flush(){
+        notEmpty_.fetch_add(1, std::memory_order_seq_cst);
+        FutexWake_(notEmpty_, 1);
+    }
+
+    void Close(){
+        isClose_.store(true, std::memory_order_release);
+        notEmpty_.fetch_add(1, std::memory_order_seq_cst);
+        notFull_.fetch_add(1, std::memory_order_seq_cst);
+        FutexWake_(notEmpty_, INT_MAX);
+        FutexWake_(notFull_, INT_MAX);
+    }
+
+    void clear(){
+        T item;
+        while(try_pop(item)){}
+    }
+
+    //以下都是近似值：先读出队位置，出队位置不会超过之后读到的入队位置
+    size_t size() const{
+        size_t head = dequeuePos_.load(std::memory_order_relaxed);
+        size_t tail = enqueuePos_.load(std::memory_order_relaxed);
+        return tail - head;
+    }
+
+    bool empty() const{ return size() == 0; }
+
+    bool full() const{ return size() >= capacity_; }
+
+    size_t capacity() const{ return capacity_; }
+
+private:
+    struct alignas(CACHE_LINE) Cell{
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    //登记为等待者，离开作用域时注销
+    struct Waiter{
+        explicit Waiter(std::atomic<int>& count): count_(count){
+            count_.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        ~Waiter(){ count_.fetch_sub(1, std::memory_order_relaxed); }
+        std::atomic<int>& count_;
+    };
+
+    /*等待者先登记再读 futex 字、再重试一次；通知者先发布元素再看有没有等待者，两边都有全序的栅栏，
+    要么等待者重试时看到元素，要么通知者看到等待者并改变 futex 字，等待者不会睡过去。*/
+    static void Notify_(std::atomic<int>& waiters, std::atomic<uint32_t>& word, int count){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(waiters.load(std::memory_order_relaxed) > 0){
+            word.fetch_add(1, std::memory_order_seq_cst);
+            FutexWake_(word, count);
+        }
+    }
+
+    //出队但不唤醒生产者，由调用方按取走的个数唤醒
+    bool TryPop_(T& item){
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while(true){
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if(dif == 0){
+                if(dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if(dif < 0){
+                return false;
+            }
+            else{
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->data);
+        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop_(T& item, int timeout){
+        if(try_pop(item)) return true;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+        Waiter waiter(consumers_);
+        while(true){
+            uint32_t seq = notEmpty_.load(std::memory_order_seq_cst);
+            if(try_pop(item)) return true;
+            if(isClose_.load(std::memory_order_acquire)) return false;
+            if(timeout < 0){
+                FutexWait_(notEmpty_, seq, nullptr);
+                continue;
+            }
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if(left <= 0) return false;
+            struct timespec ts;
+            ts.tv_sec = left / 1000000000;
+            ts.tv_nsec = left % 1000000000;
+            FutexWait_(notEmpty_, seq, &ts);
+        }
+    }
+
+    static void FutexWait_(std::atomic<uint32_t>& word, uint32_t expected, const struct timespec* timeout){
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+    }
+
+    static void FutexWake_(std::atomic<uint32_t>& word, int count){
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32-bit integer");
+
+    Cell* cells_;
+    size_t capacity_;
+    size_t mask_;
+
+    alignas(CACHE_LINE) std::atomic<size_t> enqueuePos_;
+    alignas(CACHE_LINE) std::atomic<size_t> dequeuePos_;
+    alignas(CACHE_LINE) std::atomic<uint32_t> notEmpty_;    //futex 字，有元素入队且有消费者等待时加一
+    std::atomic<int> consumers_;
+    alignas(CACHE_LINE) std::atomic<uint32_t> notFull_;
+    std::atomic<int> producers_;
+    std::atomic<bool> isClose_;
+};
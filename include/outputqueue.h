@@ -0,0 +1,130 @@
+/**
+ * @author:MgJun
+ * @brief:连接的输出队列。
+ * 原来 HttpConn 只有 iov_[2]：一块响应头缓冲区加一个文件，更多的部分只能先拼进 writeBuff_。
+ * OutputQueue 按顺序保存一串片段，片段有三种：
+ *   OWNED 队列自己的字节（从 BufferPool 借的块，用于 Connection、Date 等每次不同的内容）；
+ *   REF   引用别处的内存（缓存的响应头块、压缩结果、预加载的资源、预制的错误页），holder 保证发送完之前不被释放；
+ *   FILE  文件的一段，用 sendfile 发送，不需要映射，队列负责关闭 fd。
+ * WriteFd() 把队首连续的内存片段（最多 IOV_MAX 个）一次 sendmsg 出去，遇到文件片段再 sendfile，
+ * 部分写入时按实际写出的字节数逐段前移，写完的片段立即释放。
+ * 打开零拷贝（EnableZeroCopy）后，不小于阈值的 REF 片段单独用 MSG_ZEROCOPY 发送，内核直接引用这段内存而不拷贝；
+ * 片段的 holder 要一直保留到内核从套接字的错误队列发回完成通知（ReapZeroCopy），连接关闭时还没完成的也要再保留一段时间。
+ * 环回等内核退回拷贝的情况会在通知里标出来，计入 ZeroCopyStats 的 copied，用来对比不同阈值下的效果。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <mutex>
+#include <atomic>
+#include <assert.h>
+#include <cstring>
+
+#include "bufferpool.h"
+#include "coarseclock.h"
+
+class OutputQueue{
+public:
+    using Holder = std::shared_ptr<const void>;
+
+    OutputQueue();
+    ~OutputQueue();
+    OutputQueue(const OutputQueue&) = delete;
+    OutputQueue& operator=(const OutputQueue&) = delete;
+
+    //拷贝进队列自己的块
+    void Append(const char* data, size_t len);
+    void Append(const std::string& str) { Append(str.data(), str.size()); }
+    //在队尾预留 len 字节的连续空间，写入后用 Commit() 确认实际写了多少
+    char* Reserve(size_t len);
+    void Commit(size_t len);
+
+    //引用 data，不拷贝；holder 非空时持有到这一段发送完
+    void AppendRef(const char* data, size_t len, Holder holder = nullptr);
+    //发送 fd 从 offset 开始的 len 字节，队列接管 fd
+    void AppendFile(int fd, off_t offset, size_t len);
+
+    size_t Bytes() const { return bytes_; }
+    bool Empty() const { return segments_.empty(); }
+    //丢弃所有未发送的片段
+    void Clear();
+
+    //写一批，返回写出的字节数；出错返回 -1 并设置 saveErrno
+    ssize_t WriteFd(int fd, int* saveErrno);
+
+    //套接字已设置 SO_ZEROCOPY 时打开
+    void EnableZeroCopy(bool enable) { zeroCopy_ = enable; }
+    bool ZeroCopyEnabled() const { return zeroCopy_; }
+    //读取错误队列里的完成通知，释放对应的片段；返回处理的通知数
+    int ReapZeroCopy(int fd);
+    //还在等完成通知的发送次数
+    size_t ZeroCopyPending() const { return pins_.size(); }
+
+    //不小于 threshold 字节的片段才走零拷贝，0 表示关闭
+    static void SetZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
+    static size_t ZeroCopyThreshold() { return zeroCopyThreshold_; }
+
+    struct ZeroCopyStats{
+        unsigned long long sends;       //MSG_ZEROCOPY 发送次数
+        unsigned long long bytes;       //零拷贝发送的字节数
+        unsigned long long completed;   //收到完成通知的发送次数
+        unsigned long long copied;      //其中内核实际退回拷贝的次数
+    };
+    static ZeroCopyStats GetZeroCopyStats();
+
+private:
+    enum TYPE{
+        OWNED,
+        REF,
+        FILE,
+    };
+
+    struct Segment{
+        TYPE type;
+        const char* data;   //OWNED、REF：待发送的数据
+        size_t len;         //待发送的字节数
+        char* block;        //OWNED：借来的块
+        size_t cap;
+        Holder holder;      //REF
+        int fd;             //FILE
+        off_t offset;
+    };
+
+    void Consume_(size_t len);
+    void Release_(Segment& seg);
+    ssize_t SendZeroCopy_(int fd, int* saveErrno);
+
+    std::deque<Segment> segments_;
+    size_t bytes_;
+
+    //零拷贝发送的序号从 0 开始，和内核的计数一一对应
+    struct Pin{
+        uint32_t id;
+        Holder holder;
+    };
+    bool zeroCopy_;
+    uint32_t zcNextId_;
+    std::deque<Pin> pins_;
+
+    static std::atomic<size_t> zeroCopyThreshold_;
+    static std::atomic<unsigned long long> zcSends_, zcBytes_, zcCompleted_, zcCopied_;
+
+    //连接关闭时还没完成的零拷贝引用，保留 PIN_GRACE_MS 后再释放
+    static std::mutex orphanMtx_;
+    static std::deque<std::pair<long long, Holder>> orphans_;
+    static const long long PIN_GRACE_MS = 60 * 1000;
+
+    static const size_t OWNED_BLOCK_SIZE = 2 * 1024;
+};
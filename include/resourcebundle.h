@@ -0,0 +1,66 @@
+/**
+ * @author:MgJun
+ * @brief:启动时把资源目录预加载成一整块内存。
+ * Load() 遍历 srcDir，把不超过 maxFileSize 的文件（包括 .gz/.br 预压缩副本）依次拷贝进一块连续的内存（尽量使用大页），
+ * 同时建好相对路径到 (地址, 长度, stat) 的索引。刚部署时冷缓存导致的大量 stat、open、mmap 和缺页集中在启动阶段完成。
+ * 加载完成后内存设为只读，索引也不再修改，所以之后的查找不需要任何锁。
+ * 文件在运行期间被修改后，FileEntry 会发现 stat 不一致而改回映射磁盘上的文件。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "log.h"
+
+class ResourceBundle{
+public:
+    struct Item{
+        const char* data;
+        size_t len;
+        struct stat st;     //加载时文件的 stat，用来判断内存中的内容是否还是最新的
+    };
+
+    static ResourceBundle* Instance();
+
+    //只能在服务线程启动前调用一次
+    bool Load(const std::string& srcDir, size_t maxFileSize = 1024 * 1024, size_t maxTotalSize = 256 * 1024 * 1024);
+
+    //path 是相对 srcDir 的路径，如 "/css/style.css"；没有加载时返回 nullptr
+    const Item* Find(const std::string& path) const;
+
+    //path 的内容在内存中且与 st 描述的文件一致时返回地址
+    const char* FindFresh(const std::string& path, const struct stat& st) const;
+
+    size_t Size() const { return used_; }
+    size_t Count() const { return index_.size(); }
+    bool IsHugePage() const { return hugePage_; }
+
+private:
+    ResourceBundle();
+    ~ResourceBundle();
+
+    struct File{
+        std::string path;
+        struct stat st;
+    };
+
+    void Collect_(const std::string& srcDir, const std::string& relDir, size_t maxFileSize, std::vector<File>& files);
+    char* AllocArena_(size_t size);
+
+    char* arena_;
+    size_t arenaSize_;
+    size_t used_;
+    bool hugePage_;
+    std::unordered_map<std::string, Item> index_;
+
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+};
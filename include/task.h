@@ -0,0 +1,131 @@
+/**
+ * @author:MgJun
+ * @brief:线程池使用的任务类型。
+ * std::function 要求可拷贝，稍大一点的可调用对象就要在堆上分配。事件循环每个读写事件都要提交一个任务，
+ * Task 只支持移动，可调用对象不超过 INLINE_SIZE（48 字节）且移动不抛异常时直接放在对象内部，
+ * [this, client] 这样的 lambda、std::bind 的结果都不需要分配内存；更大的对象才放到堆上。
+ * 整个 Task 是 64 字节，正好一个缓存行。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+#include <assert.h>
+
+class Task{
+public:
+    static const size_t INLINE_SIZE = 48;
+
+    Task() noexcept: ops_(nullptr){}
+    Task(std::nullptr_t) noexcept: ops_(nullptr){}
+
+    template<class F, class D = typename std::decay<F>::type,
+             class = typename std::enable_if<!std::is_same<D, Task>::value>::type>
+    Task(F&& f): ops_(nullptr){
+        Init_<D>(std::forward<F>(f), std::integral_constant<bool, IsInline_<D>()>());
+    }
+
+    Task(Task&& other) noexcept: ops_(nullptr){
+        MoveFrom_(other);
+    }
+
+    Task& operator=(Task&& other) noexcept{
+        if(this != &other){
+            Reset_();
+            MoveFrom_(other);
+        }
+        return *this;
+    }
+
+    Task& operator=(std::nullptr_t) noexcept{
+        Reset_();
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task(){ Reset_(); }
+
+    void operator()(){
+        assert(ops_);
+        ops_->invoke(storage_);
+    }
+
+    explicit operator bool() const noexcept{ return ops_ != nullptr; }
+
+private:
+    struct Ops{
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);     //把 src 中的对象移到 dst，并析构 src 中的对象
+        void (*destroy)(void* storage);
+    };
+
+    template<class D>
+    static constexpr bool IsInline_(){
+        return sizeof(D) <= INLINE_SIZE && alignof(std::max_align_t) % alignof(D) == 0
+            && std::is_nothrow_move_constructible<D>::value;
+    }
+
+    //对象放在 storage_ 里
+    template<class D>
+    struct InlineOps{
+        static void Invoke(void* s){ (*static_cast<D*>(s))(); }
+        static void Move(void* dst, void* src){
+            new (dst) D(std::move(*static_cast<D*>(src)));
+            static_cast<D*>(src)->~D();
+        }
+        static void Destroy(void* s){ static_cast<D*>(s)->~D(); }
+        static const Ops ops;
+    };
+
+    //storage_ 里只放指向堆上对象的指针
+    template<class D>
+    struct HeapOps{
+        static D*& Ptr(void* s){ return *static_cast<D**>(s); }
+        static void Invoke(void* s){ (*Ptr(s))(); }
+        static void Move(void* dst, void* src){ *static_cast<D**>(dst) = Ptr(src); }
+        static void Destroy(void* s){ delete Ptr(s); }
+        static const Ops ops;
+    };
+
+    template<class D, class F>
+    void Init_(F&& f, std::true_type){
+        new (storage_) D(std::forward<F>(f));
+        ops_ = &InlineOps<D>::ops;
+    }
+
+    template<class D, class F>
+    void Init_(F&& f, std::false_type){
+        *reinterpret_cast<D**>(storage_) = new D(std::forward<F>(f));
+        ops_ = &HeapOps<D>::ops;
+    }
+
+    void MoveFrom_(Task& other) noexcept{
+        if(other.ops_){
+            other.ops_->move(storage_, other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    void Reset_() noexcept{
+        if(ops_){
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[INLINE_SIZE];
+    const Ops* ops_;
+};
+
+template<class D>
+const Task::Ops Task::InlineOps<D>::ops = { &Task::InlineOps<D>::Invoke, &Task::InlineOps<D>::Move, &Task::InlineOps<D>::Destroy };
+
+template<class D>
+const Task::Ops Task::HeapOps<D>::ops = { &Task::HeapOps<D>::Invoke, &Task::HeapOps<D>::Move, &Task::HeapOps<D>::Destroy };
@@ -1,67 +1,203 @@
+/**
+ * @author:MgJun
+ * @brief:工作窃取线程池。
+ * 原来所有任务都放在一把锁保护的 std::queue 里，每次 AddTask 和每次取任务都争同一把锁。
+ * 现在每个工作线程有自己的 Chase-Lev 队列（见 workstealdeque.h），事件循环提交的任务先进全局注入队列（无锁的 MpmcQueue，满了才放进加锁的溢出队列）；
+ * 工作线程按 本地队列 -> 注入队列（一次多取几个放进本地队列） -> 随机挑别的线程窃取 的顺序找活，
+ * 都没有时先自旋几轮再睡眠，提交任务时只在有线程睡眠时才加锁唤醒。
+ * 工作线程自己提交的任务直接进自己的本地队列。任务类型是只能移动的 Task（见 task.h），常见的任务不需要分配内存。
+ * 可以给排队的任务数设上限（SetQueueLimit），超过上限时按策略阻塞提交者或拒绝任务，拒绝之后怎么处理（关闭连接或回 503）由调用方决定。
+ * 工作线程提交的任务不受上限限制，避免线程池自己等自己；TryAddTask 在任何策略下都不等待，用于线程池之间转交任务。排队深度和任务等待时间记在 QueueStats 里。
+ * 工作线程由线程池持有，Shutdown 停止接收任务，在期限内把已排队的任务做完后 join 所有线程，析构时不再有任务在跑。
+ * 构造时可以给出线程数上限，运行中用 Resize 在 1 到上限之间调整线程数；每个工作线程的执行数、窃取数、忙碌和空闲时间记在 WorkerStats 里。
+ * SetAffinity 把工作线程轮流绑到给定的核上，之后 Resize 新启动的线程也按同样的规则绑定。
+ * @date:26/10/19
+*/
+
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
 #include <thread>
+#include <chrono>
 #include <functional>
 #include <assert.h>
 
+#include "task.h"
+#include "affinity.h"
+#include "alignednew.h"
+#include "workstealdeque.h"
+#include "mpmcqueue.h"
+
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t threadCount = 8): pool_(std::make_shared<Pool>()) {
-            assert(threadCount > 0);
-            for(size_t i = 0; i < threadCount; i++) {
-                std::thread([pool = pool_] {
-                    std::unique_lock<std::mutex> locker(pool->mtx);
-                    while(true) {
-                        if(!pool->tasks.empty()) {
-                            auto task = std::move(pool->tasks.front());
-                            pool->tasks.pop();
-                            locker.unlock();
-                            task();
-                            locker.lock();
-                        } 
-                        else if(pool->isClosed) break;
-                        else pool->cond.wait(locker);
-                    }
-                }).detach();
-            }
-    }
+    using Task = ::Task;
+
+    //排队任务超过上限时的处理
+    enum OVERLOAD {
+        BLOCK = 0,      //提交者等到有空位，事件循环被阻塞，不再接收新的事件
+        REJECT,         //拒绝，调用方直接关闭连接
+        SHED,           //拒绝，调用方回一个 503 后关闭连接
+    };
+
+    struct QueueStats {
+        size_t depth;                   //当前排队的任务数
+        size_t peakDepth;
+        unsigned long long submitted;   //入队的任务数
+        unsigned long long rejected;
+        unsigned long long blocked;     //因为队列满而等待过的提交次数
+        unsigned long long executed;
+        unsigned long long waitUsTotal; //从入队到开始执行的时间
+        unsigned long long waitUsMax;
+        unsigned long long runUsTotal;  //任务本身的执行时间
+        unsigned long long runUsMax;
+    };
+
+    struct WorkerStats {
+        bool running;
+        unsigned long long tasks;       //执行的任务数
+        unsigned long long steals;      //从别的线程窃取到的任务数
+        unsigned long long busyUs;      //执行任务的时间
+        unsigned long long idleUs;      //两个任务之间找活、自旋和睡眠的时间
+    };
+
+    //maxThreadCount 为 Resize 能调到的上限，0 表示和 threadCount 相同
+    explicit ThreadPool(size_t threadCount = 8, size_t maxThreadCount = 0);
 
     ThreadPool() = default;
 
     ThreadPool(ThreadPool&&) = default;
-    
-    ~ThreadPool() {
-        if(static_cast<bool>(pool_)) {
-            {
-                std::lock_guard<std::mutex> locker(pool_->mtx);
-                pool_->isClosed = true;
-            }
-            pool_->cond.notify_all();
-        }
+
+    ~ThreadPool();
+
+    //受排队上限限制，任务被拒绝时返回 false
+    template<class F>
+    bool AddTask(F&& task) {
+        return Submit_(Task(std::forward<F>(task)), true, true);
     }
 
+    //受排队上限限制，但不论什么策略队列满时都不等待，直接拒绝；用于别的线程池的工作线程转交任务，
+    //避免一个线程池满了把另一个线程池的线程也挂住
     template<class F>
-    void AddTask(F&& task) {
-        {
-            std::lock_guard<std::mutex> locker(pool_->mtx);
-            pool_->tasks.emplace(std::forward<F>(task));
-        }
-        pool_->cond.notify_one();
+    bool TryAddTask(F&& task) {
+        return Submit_(Task(std::forward<F>(task)), true, false);
     }
 
+    //不受上限限制，用于已经接受的请求的后续任务
+    template<class F>
+    void AddTaskUnbounded(F&& task) {
+        Submit_(Task(std::forward<F>(task)), false, false);
+    }
+
+    //maxPending 为 0 表示不限制；在提交任务之前调用
+    void SetQueueLimit(size_t maxPending, OVERLOAD policy);
+    OVERLOAD Policy() const { return pool_->policy; }
+    QueueStats GetQueueStats() const;
+
+    //停止接收任务，等已排队的任务执行完后 join 所有工作线程。drainMs < 0 时一直等；
+    //超过期限还没开始执行的任务被丢弃，返回丢弃的个数。正在执行的任务不能打断，总会等它结束
+    size_t Shutdown(int drainMs = -1);
+
+    //把工作线程数调整到 threadCount（1 到上限之间）。减少的线程做完自己本地队列里的任务后退出
+    void Resize(size_t threadCount);
+
+    std::vector<WorkerStats> GetWorkerStats() const;
+
+    //第 i 个工作线程绑到 cpus[i % cpus.size()]，cpus 为空时不绑定
+    void SetAffinity(const std::vector<int>& cpus);
+
+    size_t ThreadCount() const { return pool_ ? pool_->target.load(std::memory_order_relaxed) : 0; }
+    size_t MaxThreadCount() const { return pool_ ? pool_->workers.size() : 0; }
+
 private:
-    struct Pool {
-        std::mutex mtx;
+    struct Item {
+        Task task;
+        long long enqueueUs;    //入队时间，用来统计等待时间
+    };
+
+    //本地队列的两端各占一个缓存行，Worker 要按缓存行对齐分配
+    struct Worker : CacheAligned {
+        WorkStealDeque<Item> tasks;
+        unsigned seed;      //随机挑选窃取对象
+        std::thread thread;
+        bool running = false;   //由 Pool::mtx 保护
+        std::vector<Item> batch;    //只由所属线程使用，从注入队列成批取任务时复用
+
+        //只有所属线程写，其他线程读统计
+        std::atomic<unsigned long long> taskCount{0};
+        std::atomic<unsigned long long> steals{0};
+        std::atomic<unsigned long long> busyUs{0};
+        std::atomic<unsigned long long> idleUs{0};
+    };
+
+    //内含 MpmcQueue，同样要按缓存行对齐分配，不能用 make_shared
+    struct Pool : CacheAligned {
+        std::mutex mtx;     //睡眠、唤醒、关闭和增减线程
         std::condition_variable cond;
-        bool isClosed;
-        std::queue<std::function<void()>> tasks;
+        std::atomic<bool> isClosed{false};
+        long long deadlineUs = -1;  //关闭后排空的期限，-1 表示不限
+        std::atomic<int> sleeping{0};
+        std::atomic<size_t> target{0};  //编号小于 target 的工作线程在运行
+        std::atomic<size_t> dropped{0};
+        std::vector<int> cpus;  //工作线程绑定的核，由 mtx 保护
+
+        MpmcQueue<Item> injected{INJECT_CAPACITY};  //全局注入队列
+        std::mutex overflowMtx;     //注入队列满时的溢出队列，里面的任务更早，优先取走
+        std::deque<Item> overflow;
+        std::atomic<size_t> overflowSize{0};
+
+        size_t maxPending = 0;  //排队上限，0 为不限制
+        OVERLOAD policy = BLOCK;
+        std::atomic<size_t> pending{0};     //已入队还没开始执行的任务数
+        std::mutex fullMtx;     //BLOCK 策略下等待空位
+        std::condition_variable notFull;
+        std::atomic<int> blockedWaiters{0};
+
+        std::atomic<size_t> peakDepth{0};
+        std::atomic<unsigned long long> submitted{0};
+        std::atomic<unsigned long long> rejected{0};
+        std::atomic<unsigned long long> blocked{0};
+        std::atomic<unsigned long long> executed{0};
+        std::atomic<unsigned long long> waitUsTotal{0};
+        std::atomic<unsigned long long> waitUsMax{0};
+        std::atomic<unsigned long long> runUsTotal{0};
+        std::atomic<unsigned long long> runUsMax{0};
+
+        std::vector<std::unique_ptr<Worker>> workers;
     };
+
+    bool Submit_(Task&& task, bool bounded, bool mayWait);
+    static bool Admit_(Pool& pool, bool mayWait);
+
+    static void WorkerLoop_(std::shared_ptr<Pool> pool, size_t index);
+    static bool FindTask_(Pool& pool, size_t index, Item& item);
+    static bool TakeInjected_(Pool& pool, size_t index, Item& item);
+    static void PushOverflow_(Pool& pool, Item&& item);
+    static bool TakeOverflow_(Pool& pool, size_t index, Item& item);
+    static bool StealTask_(Pool& pool, size_t index, Item& item);
+    static bool HasWork_(Pool& pool);
+    static void OnDequeue_(Pool& pool, const Item& item, long long nowUs);
+    static void OnFinish_(Pool& pool, unsigned long long runUs);
+    static void Start_(const std::shared_ptr<Pool>& pool, size_t index);
+    static void Pin_(Pool& pool, size_t index);
+    static bool ShouldExit_(Pool& pool, size_t index);
+
+    static long long NowUs_() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static const int SPIN_ROUNDS = 64;      //找不到任务时睡眠前的自旋轮数
+    static const size_t INJECT_BATCH = 16;  //一次从注入队列最多取走的任务数
+    static const size_t INJECT_CAPACITY = 4096;
+
     std::shared_ptr<Pool> pool_;
 };
 
 
-#endif //THREADPOOL_H
\ No newline at end of file
+#endif //THREADPOOL_H
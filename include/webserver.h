@@ -16,6 +16,7 @@
 #pragma once
 
 #include <unordered_map>
+#include <algorithm>
 #include <fcntl.h>
 #include <unistd.h>
 #include <assert.h>
@@ -31,7 +32,46 @@
 #include "threadpool.h"
 #include "sqlconnRAII.h"
 #include "httpconn.h"
-
+#include "contentcoding.h"
+#include "compresscache.h"
+#include "resourcebundle.h"
+#include "errorpage.h"
+
+/*原有构造参数之外的可调项，按用途分组；除读缓冲的收缩策略外，默认值都是不开启对应的功能。*/
+struct ServerOptions{
+    struct Compress{
+        bool precompress = false;                   //启动时生成 .gz 预压缩副本
+        int level = Z_DEFAULT_COMPRESSION;          //运行时压缩等级
+    } compress;
+
+    struct ReadBuffer{                              //连接读缓冲的收缩策略，见 ChainBuffer::SetShrinkPolicy
+        size_t keepBytes = 8 * 1024;                //读空后留下的块超过这个大小才考虑归还
+        int idleMs = 10 * 1000;                     //空闲这么久后归还，负数不收缩
+    } readBuffer;
+
+    struct Resource{
+        bool preload = false;                       //启动时把资源预加载进内存
+        size_t zeroCopyThreshold = 0;               //零拷贝发送阈值（字节），0 关闭
+    } resource;
+
+    struct Pool{
+        size_t queueLimit = 0;                      //排队上限，0 不限制
+        ThreadPool::OVERLOAD overloadPolicy = ThreadPool::SHED;
+        int maxThreadNum = 0;                       //自动调整的最大线程数，不大于线程池数量时不调整
+        int blockingThreadNum = 0;                  //访问数据库的请求单独使用的线程数，0 不单独分开
+    } pool;
+
+    struct Cpus{                                    //绑定的 CPU，如 "0-3,8" 或 "node:0"，空串不绑定
+        const char* loop = "";
+        const char* worker = "";
+        const char* log = "";
+    } cpus;
+
+    struct LogFlush{
+        Log::FLUSH_POLICY policy = Log::ON_LEVEL;
+        int value = 3;
+    } logFlush;
+};
 
 class WebServer{
 
@@ -40,7 +80,8 @@ public:
         int port, int trigMode, int timeoutMs, bool OptLinger,
         int sqlPort, const char* sqlUser, const char* sqlPwd,
         const char* dbname, int connPoolNum, int threadNum,
-        bool openLog, int LogLevel, int LogQueSize
+        bool openLog, int LogLevel, int LogQueSize,
+        const ServerOptions& options = ServerOptions()
     );
 
     ~WebServer();
@@ -49,6 +90,7 @@ public:
 private:
     bool InitSocket_();
     void InitEventMode_(int trigMode);
+    void InitAffinity_(const ServerOptions::Cpus& cpus);
     void AddClient_(int fd, sockaddr_in addr);
 
 
@@ -57,6 +99,11 @@ private:
     void DealRead_(HttpConn* client);
 
     void SendError_(int fd, const char* info);
+    void OnOverload_(HttpConn* client, ThreadPool::OVERLOAD policy);
+    void TunePool_();
+    void ReleaseIdle_();
+    void ProcessOnLane_(HttpConn* client);
+    static void LogPoolStats_(const char* lane, ThreadPool& pool, size_t dropped);
     void ExtentTime_(HttpConn* client);
     void CloseConn_(HttpConn* client);
 
@@ -66,6 +113,9 @@ private:
     void OnProcess(HttpConn* client);
 
     static const int MAX_FD = 65536;
+    static const int TUNE_INTERVAL_MS = 1000;   //线程数自动调整的间隔
+    static const int RELEASE_INTERVAL_MS = 1000;    //检查空闲连接缓冲的间隔
+    static const int DRAIN_MS = 3000;           //退出时等待线程池排空的时间
 
     static int SetFdNonblock(int fd);
 
@@ -77,6 +127,13 @@ private:
     int listenFd_;
     char* srcDir_;
 
+    size_t minThreadNum_;   //自动调整线程数的范围，相等时不调整
+    size_t maxThreadNum_;
+    long long lastTuneMs_;
+    unsigned long long lastBusyUs_;
+    int shrinkIdleMs_;      //读缓冲的空闲归还时间，负数不做定期检查
+    long long lastReleaseMs_;
+
 
     uint32_t listenEvent_;
     uint32_t  connEvent_;
@@ -84,6 +141,7 @@ private:
 
     std::unique_ptr<HeapTimer> timer_;
     std::unique_ptr<ThreadPool> threadpool_;
+    std::unique_ptr<ThreadPool> blockingPool_;  //可能阻塞在数据库上的任务，为空时和其他任务共用 threadpool_
     std::unique_ptr<Epoller> epoller_;
     std::unordered_map<int, HttpConn> users_;
 };
\ No newline at end of file
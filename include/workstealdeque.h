@@ -0,0 +1,99 @@
+/**
+ * @author:MgJun
+ * @brief:工作窃取用的 Chase-Lev 双端队列。
+ * 只有所属的工作线程在底部 Push / Pop，其他线程从顶部 Steal；底部操作在没有竞争时不需要 CAS，只有抢最后一个元素时才和窃取者 CAS。
+ * 元素不是平凡类型（任务对象），不能像论文里那样先读出再 CAS：窃取者先 CAS 抢到位置，再把元素移出来，
+ * 每个槽带一个 full 标志，移出后才清掉；所有者 Push 绕回到一个还没被移走的槽时等它清掉。
+ * 容量固定，满了 Push 返回 false，由调用方放到全局队列。
+ * @date:26/10/19
+*/
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <assert.h>
+
+template<class T, size_t CAPACITY = 256>
+class WorkStealDeque{
+public:
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of 2");
+
+    WorkStealDeque(): top_(0), bottom_(0){
+        for(size_t i = 0; i < CAPACITY; i++){
+            slots_[i].full.store(false, std::memory_order_relaxed);
+        }
+    }
+    WorkStealDeque(const WorkStealDeque&) = delete;
+    WorkStealDeque& operator=(const WorkStealDeque&) = delete;
+
+    //只能由所属线程调用
+    bool Push(T&& item){
+        long b = bottom_.load(std::memory_order_relaxed);
+        long t = top_.load(std::memory_order_acquire);
+        if(b - t >= static_cast<long>(CAPACITY)) return false;
+        Slot& slot = slots_[b & MASK];
+        while(slot.full.load(std::memory_order_acquire)){   //窃取者抢到了位置但还没移走
+            std::this_thread::yield();
+        }
+        slot.item = std::move(item);
+        slot.full.store(true, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    //只能由所属线程调用，后进先出
+    bool Pop(T& item){
+        long b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long t = top_.load(std::memory_order_relaxed);
+        if(t > b){  //空
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        if(t == b){ //最后一个，和窃取者抢
+            bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            if(!won) return false;
+        }
+        Take_(slots_[b & MASK], item);
+        return true;
+    }
+
+    //任意线程调用，先进先出；和别的窃取者或所有者竞争失败时返回 false
+    bool Steal(T& item){
+        long t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long b = bottom_.load(std::memory_order_acquire);
+        if(t >= b) return false;
+        if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)){
+            return false;
+        }
+        Take_(slots_[t & MASK], item);
+        return true;
+    }
+
+    //近似值，只用来判断有没有活可干
+    bool Empty() const{
+        return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot{
+        T item;
+        std::atomic<bool> full;
+    };
+
+    static void Take_(Slot& slot, T& item){
+        item = std::move(slot.item);
+        slot.item = T();
+        slot.full.store(false, std::memory_order_release);
+    }
+
+    static const size_t MASK = CAPACITY - 1;
+
+    alignas(64) std::atomic<long> top_;
+    alignas(64) std::atomic<long> bottom_;
+    alignas(64) Slot slots_[CAPACITY];
+};
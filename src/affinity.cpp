@@ -0,0 +1,86 @@
+#include "affinity.h"
+
+using namespace std;
+
+vector<int> Affinity::ParseList_(const char* list){
+    vector<int> cpus;
+    const char* p = list;
+    while(*p){
+        char* end = nullptr;
+        long first = strtol(p, &end, 10);
+        if(end == p) break;
+        long last = first;
+        p = end;
+        if(*p == '-'){
+            last = strtol(p + 1, &end, 10);
+            if(end == p + 1) break;
+            p = end;
+        }
+        for(long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++){
+            if(cpu >= 0) cpus.push_back(static_cast<int>(cpu));
+        }
+        while(*p == ',' || *p == ' ' || *p == '\n') p++;
+    }
+    return cpus;
+}
+
+vector<int> Affinity::Parse(const string& spec){
+    static const char NODE_PREFIX[] = "node:";
+    if(spec.compare(0, sizeof(NODE_PREFIX) - 1, NODE_PREFIX) == 0){
+        return NodeCpus(atoi(spec.data() + sizeof(NODE_PREFIX) - 1));
+    }
+    return ParseList_(spec.data());
+}
+
+//sysfs 里 cpuN 目录下有一个指向所在节点的 nodeK 链接
+int Affinity::NodeOf(int cpu){
+    char path[64] = { 0 };
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dp = opendir(path);
+    if(!dp) return -1;
+    int node = -1;
+    struct dirent* entry;
+    while((entry = readdir(dp)) != nullptr){
+        if(strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9'){
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dp);
+    return node;
+}
+
+vector<int> Affinity::NodeCpus(int node){
+    if(node < 0) return {};
+    char path[64] = { 0 };
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE* fp = fopen(path, "r");
+    if(!fp) return {};
+    char list[1024] = { 0 };
+    if(!fgets(list, sizeof(list), fp)) list[0] = '\0';
+    fclose(fp);
+    return ParseList_(list);
+}
+
+bool Affinity::Pin(pthread_t thread, const vector<int>& cpus){
+    if(cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu : cpus){
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+string Affinity::ToString(const vector<int>& cpus){
+    string result;
+    for(size_t i = 0; i < cpus.size(); ){
+        size_t j = i;
+        while(j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) j++;
+        if(!result.empty()) result += ",";
+        result += to_string(cpus[i]);
+        if(j > i) result += "-" + to_string(cpus[j]);
+        i = j + 1;
+    }
+    return result;
+}
@@ -1,13 +1,20 @@
 #include "buffer.h"
 
-Buffer::Buffer(int initBuffSize):buffer_(initBuffSize), readPos_(0), writePos_(0){}
+Buffer::Buffer(int initBuffSize):buffer_(nullptr), capacity_(initBuffSize), readPos_(0), writePos_(0){
+    assert(initBuffSize > 0);
+    buffer_ = BufferPool::Alloc(&capacity_);
+}
+
+Buffer::~Buffer(){
+    BufferPool::Free(buffer_, capacity_);
+}
 
 size_t Buffer::ReadableBytes() const{
     return writePos_ - readPos_;
 }
 
 size_t Buffer::WriteableBytes() const{
-    return buffer_.size() - writePos_;
+    return capacity_ - writePos_;
 }
 
 size_t Buffer::PrependableBytes() const{
@@ -38,8 +45,8 @@ void Buffer::RetrieveUntil(const char* end){
     Retrieve(end - Peek());
 }
 
+//只重置读写位置，不清零内存
 void Buffer::RetrieveAll(){
-    bzero(&buffer_[0], buffer_.size());
     readPos_ = 0;
     writePos_ = 0;
 }
@@ -85,15 +92,15 @@ char* Buffer::BeginWrite(){
 }
 
 char* Buffer::BeginPtr_(){
-    return &*buffer_.begin();
+    return buffer_;
 }
 
 const char* Buffer::BeginPtr_() const{
-    return &*buffer_.begin();
+    return buffer_;
 }
 //将数据从文件中读到分散的内存中
 ssize_t Buffer::readFd(int fd, int* saveErrno){
-    char buff[65535];
+    static thread_local char buff[65535];  //线程共享的溢出区，不再占用 64K 的栈
     struct iovec iov[2];
     const size_t writeable = WriteableBytes();
     /*分散读，保证数据全部读完，参考Linux高性能服务器第六章高级io*/
@@ -108,7 +115,7 @@ ssize_t Buffer::readFd(int fd, int* saveErrno){
     else if(static_cast<size_t>(len) <= writeable) //buffer_大小够用，将写指针置后
         writePos_ += len;
     else{                                           //buffer_放不下，剩下的内容放入buff数组，然后将buff数组加入到buffer_中
-        writePos_ = buffer_.size();
+        writePos_ = capacity_;
         Append(buff, len - writeable);
     }
     return len;
@@ -132,7 +139,10 @@ void Buffer::MakeSpace_(size_t len){
         //如果buffer_里面剩余的空间有len就进行调整，否则需要申请空间。
     //剩余空间包括write指针之前的空间和可写的空间
     if(WriteableBytes() + PrependableBytes() < len){
-        buffer_.resize(writePos_ + len +1);
+        //按两倍增长，避免连续追加时每次都重新分配
+        size_t capacity = capacity_ * 2;
+        while(capacity < ReadableBytes() + len) capacity *= 2;
+        Reallocate_(capacity);
     }else{
         size_t readable = ReadableBytes();
         std::copy(BeginPtr_() + readPos_, BeginPtr_() + writePos_, BeginPtr_());
@@ -140,4 +150,16 @@ void Buffer::MakeSpace_(size_t len){
         writePos_ = readPos_ + readable;
         assert(readable == ReadableBytes());
     }
-}
\ No newline at end of file
+}
+
+void Buffer::Reallocate_(size_t capacity){
+    size_t readable = ReadableBytes();
+    assert(capacity >= readable);
+    char* block = BufferPool::Alloc(&capacity);
+    std::copy(BeginPtr_() + readPos_, BeginPtr_() + writePos_, block);
+    BufferPool::Free(buffer_, capacity_);
+    buffer_ = block;
+    capacity_ = capacity;
+    readPos_ = 0;
+    writePos_ = readable;
+}
@@ -0,0 +1,78 @@
+#include "bufferpool.h"
+
+using namespace std;
+
+const size_t BufferPool::CLASS_SIZE[CLASS_COUNT] = { 2 * 1024, 8 * 1024, 32 * 1024, 128 * 1024 };
+
+thread_local BufferPool::FreeList BufferPool::lists_[CLASS_COUNT];
+thread_local bool BufferPool::released_ = false;
+
+BufferPool::Releaser::~Releaser(){
+    for(int i = 0; i < CLASS_COUNT; i++){
+        while(lists_[i].head){
+            Node* node = lists_[i].head;
+            lists_[i].head = node->next;
+            free(node);
+        }
+        lists_[i].count = 0;
+    }
+    released_ = true;
+}
+
+//线程第一次使用时构造 Releaser，登记线程退出时的清理；已经清理过的线程返回 nullptr
+BufferPool::FreeList* BufferPool::Lists_(){
+    static thread_local Releaser releaser;
+    (void)releaser;
+    return released_ ? nullptr : lists_;
+}
+
+int BufferPool::ClassOf_(size_t size){
+    for(int i = 0; i < CLASS_COUNT; i++){
+        if(size <= CLASS_SIZE[i]) return i;
+    }
+    return -1;
+}
+
+size_t BufferPool::RoundUp(size_t size){
+    int idx = ClassOf_(size);
+    return idx < 0 ? size : CLASS_SIZE[idx];
+}
+
+char* BufferPool::Alloc(size_t* size){
+    assert(size);
+    int idx = ClassOf_(*size);
+    if(idx < 0){
+        char* block = static_cast<char*>(malloc(*size));
+        assert(block);
+        return block;
+    }
+    *size = CLASS_SIZE[idx];
+    FreeList* lists = Lists_();
+    if(lists && lists[idx].head){
+        Node* node = lists[idx].head;
+        lists[idx].head = node->next;
+        lists[idx].count--;
+        return reinterpret_cast<char*>(node);
+    }
+    char* block = static_cast<char*>(malloc(*size));
+    assert(block);
+    return block;
+}
+
+void BufferPool::Free(char* block, size_t size){
+    if(!block) return;
+    int idx = ClassOf_(size);
+    if(idx < 0 || CLASS_SIZE[idx] != size){
+        free(block);
+        return;
+    }
+    FreeList* lists = Lists_();
+    if(!lists || lists[idx].count >= MAX_FREE_BLOCKS){
+        free(block);
+        return;
+    }
+    Node* node = reinterpret_cast<Node*>(block);
+    node->next = lists[idx].head;
+    lists[idx].head = node;
+    lists[idx].count++;
+}
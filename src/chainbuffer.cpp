@@ -0,0 +1,301 @@
+#include "chainbuffer.h"
+
+using namespace std;
+
+atomic<size_t> ChainBuffer::keepBytes_(8 * 1024);
+atomic<int> ChainBuffer::idleMs_(10 * 1000);
+
+void ChainBuffer::SetShrinkPolicy(size_t keepBytes, int idleMs){
+    keepBytes_ = BufferPool::RoundUp(keepBytes);
+    idleMs_ = idleMs;
+}
+
+ChainBuffer::ChainBuffer(size_t blockSize):
+    readable_(0), blockSize_(BufferPool::RoundUp(blockSize)), readHint_(blockSize_), lastReadFull_(false), bigUsedMs_(0){
+    assert(blockSize > 0);
+}
+
+ChainBuffer::~ChainBuffer(){
+    Shrink();
+}
+
+ChainBuffer::Block ChainBuffer::NewBlock_(size_t size){
+    Block block;
+    block.cap = size;
+    block.data = BufferPool::Alloc(&block.cap);
+    block.read = block.write = 0;
+    return block;
+}
+
+void ChainBuffer::FreeBlock_(Block& block){
+    BufferPool::Free(block.data, block.cap);
+    block.data = nullptr;
+    block.cap = block.read = block.write = 0;
+}
+
+const char* ChainBuffer::Peek() const{
+    if(blocks_.empty()) return nullptr;
+    const Block& head = blocks_.front();
+    return head.data + head.read;
+}
+
+const char* ChainBuffer::PeekEnd() const{
+    if(blocks_.empty()) return nullptr;
+    const Block& head = blocks_.front();
+    return head.data + head.write;
+}
+
+/*第一块放得下就把后面块的数据补到第一块末尾（必要时先把第一块的数据挪到开头），
+放不下就换一块足够大的新块。被搬空的块还回内存池。*/
+void ChainBuffer::Pullup(size_t len){
+    assert(len <= readable_);
+    if(blocks_.empty() || blocks_.front().write - blocks_.front().read >= len) return;
+
+    Block& head = blocks_.front();
+    size_t have = head.write - head.read;
+    if(head.cap - head.read < len){
+        if(head.cap >= len){
+            memmove(head.data, head.data + head.read, have);
+        }
+        else{
+            Block block = NewBlock_(len);
+            memcpy(block.data, head.data + head.read, have);
+            FreeBlock_(head);
+            head = block;
+        }
+        head.read = 0;
+        head.write = have;
+    }
+    while(have < len){
+        //从 deque 中间删除会让引用失效，每轮重新取
+        Block& first = blocks_[0];
+        Block& next = blocks_[1];
+        size_t n = min(len - have, next.write - next.read);
+        memcpy(first.data + first.write, next.data + next.read, n);
+        first.write += n;
+        next.read += n;
+        have += n;
+        if(next.read == next.write){
+            FreeBlock_(next);
+            blocks_.erase(blocks_.begin() + 1);
+        }
+    }
+}
+
+const char* ChainBuffer::FindCRLF(){
+    if(readable_ == 0) return nullptr;
+    const Block& head = blocks_.front();
+    const char* begin = head.data + head.read;
+    const char* end = head.data + head.write;
+    const char* found = static_cast<const char*>(memmem(begin, end - begin, "\r\n", 2));
+    if(found) return found;
+
+    //跨块：逐块往后找，"\r" 和 "\n" 可能恰好分在两块
+    size_t offset = end - begin;
+    char last = end > begin ? end[-1] : '\0';
+    for(size_t i = 1; i < blocks_.size(); i++){
+        const Block& block = blocks_[i];
+        const char* b = block.data + block.read;
+        size_t n = block.write - block.read;
+        size_t lineLen = 0;
+        if(last == '\r' && n > 0 && b[0] == '\n'){
+            lineLen = offset + 1;
+        }
+        else if(const char* f = static_cast<const char*>(memmem(b, n, "\r\n", 2))){
+            lineLen = offset + (f - b) + 2;
+        }
+        if(lineLen){
+            Pullup(lineLen);
+            return Peek() + lineLen - 2;
+        }
+        offset += n;
+        if(n > 0) last = b[n - 1];
+    }
+    return nullptr;
+}
+
+void ChainBuffer::Retrieve(size_t len){
+    assert(len <= readable_);
+    readable_ -= len;
+    while(len > 0){
+        Block& head = blocks_.front();
+        size_t n = min(len, head.write - head.read);
+        head.read += n;
+        len -= n;
+        if(head.read == head.write){
+            if(blocks_.size() > 1){
+                FreeBlock_(head);
+                blocks_.pop_front();
+            }
+            else{
+                ReleaseIdle_();
+            }
+        }
+    }
+}
+
+void ChainBuffer::ReleaseIdle(){
+    if(readable_ == 0 && !blocks_.empty()){
+        ReleaseIdle_();
+    }
+}
+
+/*write 是这一轮用到的最高位置：用到了大块就记下时间，否则看大块是否已经空闲够久，够久就还回内存池，
+下一次 readFd 再按 readHint_ 借块。*/
+void ChainBuffer::ReleaseIdle_(){
+    Block& head = blocks_.front();
+    size_t used = head.write;
+    head.read = head.write = 0;
+    size_t keep = keepBytes_.load(memory_order_relaxed);
+    int idleMs = idleMs_.load(memory_order_relaxed);
+    if(head.cap <= keep || idleMs < 0) return;
+    long long now = CoarseClock::Instance()->NowMs();
+    if(used > keep){
+        bigUsedMs_ = now;
+    }
+    else if(now - bigUsedMs_ >= idleMs){
+        FreeBlock_(head);
+        blocks_.pop_front();
+    }
+}
+
+void ChainBuffer::RetrieveUntil(const char* end){
+    assert(Peek() <= end && end <= PeekEnd());
+    Retrieve(end - Peek());
+}
+
+void ChainBuffer::RetrieveAll(){
+    while(blocks_.size() > 1){
+        FreeBlock_(blocks_.back());
+        blocks_.pop_back();
+    }
+    readable_ = 0;
+    if(!blocks_.empty()){
+        ReleaseIdle_();
+    }
+}
+
+void ChainBuffer::Shrink(){
+    for(Block& block : blocks_){
+        FreeBlock_(block);
+    }
+    blocks_.clear();
+    readable_ = 0;
+}
+
+void ChainBuffer::Append(const char* data, size_t len){
+    assert(data || len == 0);
+    readable_ += len;
+    while(len > 0){
+        if(blocks_.empty() || blocks_.back().write == blocks_.back().cap){
+            //一次追加很多数据时用大一些的块，但不超过内存池的最大等级
+            size_t want = min(len, BufferPool::CLASS_SIZE[BufferPool::CLASS_COUNT - 1]);
+            blocks_.push_back(NewBlock_(max(blockSize_, want)));
+        }
+        Block& tail = blocks_.back();
+        size_t n = min(len, tail.cap - tail.write);
+        memcpy(tail.data + tail.write, data, n);
+        tail.write += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void ChainBuffer::NoteMessageSize(size_t size){
+    //新的大小占四分之一的权重，偶尔一个大请求不会让之后的小请求都借大块
+    readHint_ = (readHint_ * 3 + size) / 4;
+    readHint_ = max(readHint_, BufferPool::CLASS_SIZE[0]);
+    readHint_ = min(readHint_, BufferPool::CLASS_SIZE[BufferPool::CLASS_COUNT - 1]);
+}
+
+//平时按 readHint_；上次读满了就问内核还有多少没读
+size_t ChainBuffer::ReadSize_(int fd){
+    size_t size = readHint_;
+    if(lastReadFull_){
+        int pending = 0;
+        if(ioctl(fd, FIONREAD, &pending) == 0 && pending > 0){
+            size = max(size, static_cast<size_t>(pending));
+        }
+    }
+    return min(size, BufferPool::CLASS_SIZE[BufferPool::CLASS_COUNT - 1]);
+}
+
+/*iov[0] 是链尾剩余的空间，iov[1] 是按 ReadSize_() 新借来的块，iov[2] 是线程共享的溢出区。
+读到新块里的数据直接把块挂上链，没用到就还回去；溢出区里的数据再追加进链。*/
+ssize_t ChainBuffer::readFd(int fd, int* saveErrno){
+    static thread_local char overflow[OVERFLOW_SIZE];
+    struct iovec iov[MAX_READ_IOV];
+    int cnt = 0;
+    size_t tailFree = 0;
+    if(!blocks_.empty()){
+        Block& tail = blocks_.back();
+        if(tail.read == tail.write){    //空块从头写
+            tail.read = tail.write = 0;
+        }
+        tailFree = tail.cap - tail.write;
+        if(tailFree > 0){
+            iov[cnt].iov_base = tail.data + tail.write;
+            iov[cnt].iov_len = tailFree;
+            cnt++;
+        }
+    }
+    Block spare = NewBlock_(ReadSize_(fd));
+    iov[cnt].iov_base = spare.data;
+    iov[cnt].iov_len = spare.cap;
+    cnt++;
+    iov[cnt].iov_base = overflow;
+    iov[cnt].iov_len = sizeof(overflow);
+    cnt++;
+
+    const ssize_t len = readv(fd, iov, cnt);
+    lastReadFull_ = false;
+    if(len < 0){
+        *saveErrno = errno;
+    }
+    else if(len > 0){
+        size_t n = static_cast<size_t>(len);
+        lastReadFull_ = n >= tailFree + spare.cap;
+        size_t inTail = min(n, tailFree);
+        if(inTail > 0){
+            blocks_.back().write += inTail;
+            readable_ += inTail;
+            n -= inTail;
+        }
+        size_t inSpare = min(n, spare.cap);
+        if(inSpare > 0){
+            spare.write = inSpare;
+            blocks_.push_back(spare);
+            readable_ += inSpare;
+            n -= inSpare;
+            Append(overflow, n);
+            return len;
+        }
+    }
+    FreeBlock_(spare);
+    return len;
+}
+
+int ChainBuffer::FillIovec(struct iovec* iov, int max) const{
+    int cnt = 0;
+    for(size_t i = 0; i < blocks_.size() && cnt < max; i++){
+        const Block& block = blocks_[i];
+        if(block.read == block.write) continue;
+        iov[cnt].iov_base = block.data + block.read;
+        iov[cnt].iov_len = block.write - block.read;
+        cnt++;
+    }
+    return cnt;
+}
+
+ssize_t ChainBuffer::writeFd(int fd, int* saveErrno){
+    struct iovec iov[MAX_WRITE_IOV];
+    int cnt = FillIovec(iov, MAX_WRITE_IOV);
+    if(cnt == 0) return 0;
+    ssize_t len = writev(fd, iov, cnt);
+    if(len < 0){
+        *saveErrno = errno;
+        return len;
+    }
+    Retrieve(len);
+    return len;
+}
@@ -0,0 +1,137 @@
+#include "coarseclock.h"
+
+using namespace std;
+
+const long long CoarseClock::MAX_AGE_NS;
+
+CoarseClock::CoarseClock(){
+    monoNs_ = 0;
+    seq_ = 0;
+    sec_ = 0;
+    dateBufLen_ = logTimeBufLen_ = 0;
+    bufMday_ = 0;
+    memset(dateBuf_, 0, sizeof(dateBuf_));
+    memset(logTimeBuf_, 0, sizeof(logTimeBuf_));
+    Update_();
+}
+
+CoarseClock* CoarseClock::Instance(){
+    static CoarseClock clock;
+    return &clock;
+}
+
+/*时间跨秒时才重新格式化 Date 和日志时间的日期部分，同一秒内只改写日志时间末尾的微秒数字。
+多个线程同时调用时只有拿到锁的那个更新，其余直接返回，反正拿到的时间都差不多。*/
+void CoarseClock::Update(){
+    Update_();
+}
+
+void CoarseClock::Update_(){
+    unique_lock<mutex> locker(writeMtx_, try_to_lock);
+    if(!locker.owns_lock()) return;
+
+    struct timespec real;
+    clock_gettime(CLOCK_REALTIME, &real);
+    long long mono = MonoNs_();
+
+    if(real.tv_sec != sec_){
+        sec_ = real.tv_sec;
+        struct tm gmt, local;
+        gmtime_r(&sec_, &gmt);
+        localtime_r(&sec_, &local);
+        dateBufLen_ = strftime(dateBuf_, DATE_HEADER_LEN, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &gmt);
+        //微秒先占位，下面统一填写
+        logTimeBufLen_ = snprintf(logTimeBuf_, LOG_TIME_LEN, "%d-%02d-%02d %02d:%02d:%02d.000000 ",
+                                local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+                                local.tm_hour, local.tm_min, local.tm_sec);
+        bufMday_ = local.tm_mday;
+    }
+    long usec = real.tv_nsec / 1000;
+    for(int i = 2; i <= 7; i++){    //从空格前一位往前写 6 位微秒
+        logTimeBuf_[logTimeBufLen_ - i] = '0' + usec % 10;
+        usec /= 10;
+    }
+
+    seq_.fetch_add(1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);     //奇数的 seq_ 先于下面的内容可见
+    Publish_(date_, dateBuf_, DATE_WORDS);
+    dateLen_.store(dateBufLen_, memory_order_relaxed);
+    Publish_(logTime_, logTimeBuf_, LOG_TIME_WORDS);
+    logTimeLen_.store(logTimeBufLen_, memory_order_relaxed);
+    mday_.store(bufMday_, memory_order_relaxed);
+    seq_.fetch_add(1, memory_order_release);
+    monoNs_.store(mono, memory_order_release);
+}
+
+long long CoarseClock::MonoNs_(){
+    struct timespec mono;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    return mono.tv_sec * 1000000000LL + mono.tv_nsec;
+}
+
+void CoarseClock::Publish_(atomic<uint64_t>* words, const char* src, size_t count){
+    for(size_t i = 0; i < count; i++){
+        uint64_t word;
+        memcpy(&word, src + i * 8, 8);
+        words[i].store(word, memory_order_relaxed);
+    }
+}
+
+void CoarseClock::Load_(const atomic<uint64_t>* words, char* dst, size_t count){
+    for(size_t i = 0; i < count; i++){
+        uint64_t word = words[i].load(memory_order_relaxed);
+        memcpy(dst + i * 8, &word, 8);
+    }
+}
+
+//缓存的时间超过 MAX_AGE_NS 就刷新，事件循环睡着时由读者自己推动
+void CoarseClock::RefreshIfStale_(){
+    if(MonoNs_() - monoNs_.load(memory_order_relaxed) >= MAX_AGE_NS){
+        Update_();
+    }
+}
+
+chrono::steady_clock::time_point CoarseClock::Now(){
+    RefreshIfStale_();
+    return chrono::steady_clock::time_point(chrono::nanoseconds(monoNs_.load(memory_order_acquire)));
+}
+
+long long CoarseClock::NowMs(){
+    RefreshIfStale_();
+    return monoNs_.load(memory_order_acquire) / 1000000;
+}
+
+size_t CoarseClock::DateHeader(char* buf){
+    RefreshIfStale_();
+    unsigned seq;
+    size_t len;
+    do{
+        seq = seq_.load(memory_order_acquire);
+        len = dateLen_.load(memory_order_relaxed);
+        Load_(date_, buf, DATE_WORDS);
+        atomic_thread_fence(memory_order_acquire);
+    }while((seq & 1) || seq != seq_.load(memory_order_relaxed));
+    return len;
+}
+
+size_t CoarseClock::LogTime(char* buf, int* mday){
+    RefreshIfStale_();
+    unsigned seq;
+    size_t len;
+    do{
+        seq = seq_.load(memory_order_acquire);
+        len = logTimeLen_.load(memory_order_relaxed);
+        *mday = mday_.load(memory_order_relaxed);
+        Load_(logTime_, buf, LOG_TIME_WORDS);
+        atomic_thread_fence(memory_order_acquire);
+    }while((seq & 1) || seq != seq_.load(memory_order_relaxed));
+    return len;
+}
+
+string CoarseClock::FormatHttpDate(time_t t){
+    struct tm tm = { 0 };
+    gmtime_r(&t, &tm);
+    char buf[32] = { 0 };
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
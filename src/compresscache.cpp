@@ -0,0 +1,102 @@
+#include "compresscache.h"
+
+using namespace std;
+
+CompressCache::CompressCache(){
+    level_ = Z_DEFAULT_COMPRESSION;
+    minSize_ = 1024;
+    maxBytes_ = 64 * 1024 * 1024;
+    totalBytes_ = 0;
+}
+
+CompressCache* CompressCache::Instance(){
+    static CompressCache cache;
+    return &cache;
+}
+
+void CompressCache::Init(int level, size_t minSize, size_t maxBytes){
+    assert(level == Z_DEFAULT_COMPRESSION || (level >= Z_NO_COMPRESSION && level <= Z_BEST_COMPRESSION));
+    lock_guard<mutex> locker(mtx_);
+    level_ = level;
+    minSize_ = minSize;
+    maxBytes_ = maxBytes;
+}
+
+bool CompressCache::ShouldCompress(const string& path, size_t len) const{
+    return len >= minSize_ && ContentCoding::IsCompressible(path);
+}
+
+/*key 由 path、version、encoding 拼成，中间用 '\0' 隔开避免歧义。
+未命中时先放入一个未完成的 future 再解锁压缩，其他线程拿到同一个 future 等待即可，保证同一份内容只压缩一次。*/
+CompressCache::Result CompressCache::Get(const string& path, const string& version,
+                            ContentCoding::CODING coding, const Compressor& compress){
+    string key = path;
+    key += '\0';
+    key += version;
+    key += '\0';
+    key += static_cast<char>('0' + coding);
+
+    promise<Result> prom;
+    shared_future<Result> future;
+    {
+        lock_guard<mutex> locker(mtx_);
+        auto it = cache_.find(key);
+        if(it != cache_.end()){
+            lru_.splice(lru_.begin(), lru_, it->second.lru);
+            future = it->second.result;
+        }
+        else{
+            lru_.push_front(key);
+            cache_[key] = { prom.get_future().share(), 0, lru_.begin() };
+        }
+    }
+    if(future.valid()){
+        return future.get();
+    }
+
+    shared_ptr<string> out = make_shared<string>();
+    Result result;
+    if(compress(*out)){
+        result = out;
+    }
+    else{
+        LOG_WARN("Compress %s (%s) error!", path.data(), ContentCoding::Name(coding));
+    }
+    prom.set_value(result);
+
+    lock_guard<mutex> locker(mtx_);
+    auto it = cache_.find(key);
+    if(it == cache_.end()) return result;   //压缩期间被 Clear 了
+    if(!result){
+        //失败的结果不缓存，下次再试
+        lru_.erase(it->second.lru);
+        cache_.erase(it);
+        return result;
+    }
+    it->second.bytes = result->size();
+    totalBytes_ += result->size();
+    Evict_();
+    LOG_DEBUG("Compress %s (%s): %d bytes", path.data(), ContentCoding::Name(coding), (int)result->size());
+    return result;
+}
+
+//从表尾淘汰到总大小不超过上限，还在压缩中的条目（bytes 为 0）不计入也不淘汰
+void CompressCache::Evict_(){
+    auto it = lru_.end();
+    while(totalBytes_ > maxBytes_ && it != lru_.begin()){
+        --it;
+        auto entry = cache_.find(*it);
+        assert(entry != cache_.end());
+        if(entry->second.bytes == 0) continue;
+        totalBytes_ -= entry->second.bytes;
+        cache_.erase(entry);
+        it = lru_.erase(it);
+    }
+}
+
+void CompressCache::Clear(){
+    lock_guard<mutex> locker(mtx_);
+    cache_.clear();
+    lru_.clear();
+    totalBytes_ = 0;
+}
@@ -0,0 +1,183 @@
+#include "contentcoding.h"
+
+using namespace std;
+
+const char* ContentCoding::NAME[CODING_COUNT] = { "identity", "gzip", "deflate", "br" };
+
+const char* ContentCoding::SUFFIX[CODING_COUNT] = { "", ".gz", nullptr, ".br" };
+
+//不属于 text/*、+xml、+json、javascript 这几类，但同样没有压缩过的类型
+const char* ContentCoding::COMPRESSIBLE_TYPE[] = {
+    "application/json", "application/wasm", "font/ttf", "font/otf",
+    "application/vnd.ms-fontobject", "image/x-icon", nullptr,
+};
+
+const char* ContentCoding::Name(CODING coding){
+    assert(coding >= IDENTITY && coding < CODING_COUNT);
+    return NAME[coding];
+}
+
+const char* ContentCoding::Suffix(CODING coding){
+    assert(coding >= IDENTITY && coding < CODING_COUNT);
+    return SUFFIX[coding];
+}
+
+static bool EndsWith(const char* s, size_t len, const char* suffix){
+    size_t n = strlen(suffix);
+    return len >= n && memcmp(s + len - n, suffix, n) == 0;
+}
+
+//类型从 MimeType 的表里取，新加的后缀只要类型归类正确就会自动参与压缩，两张表不会对不上
+bool ContentCoding::IsCompressible(const string& path){
+    const char* type = MimeType::Find(path.data(), path.size());
+    if(!type) return false;
+    size_t len = strlen(type);
+    if(strncmp(type, "text/", 5) == 0 || EndsWith(type, len, "+xml") || EndsWith(type, len, "+json")
+        || strstr(type, "javascript")){
+        return true;
+    }
+    for(const char** t = COMPRESSIBLE_TYPE; *t; ++t){
+        if(strcmp(type, *t) == 0) return true;
+    }
+    return false;
+}
+
+/*Accept-Encoding 形如 "gzip;q=0.8, br, *;q=0.1"，逐项解析出编码名和 q 值。
+没出现过的编码取 "*" 的 q 值；identity 除非被显式（或通过 "*"）置为 0，否则总是可接受的，但优先级最低。
+q 值为 0 表示不接受，q 值相同时按 br > gzip > deflate > identity 的顺序挑选。*/
+ContentCoding::CODING ContentCoding::Negotiate(const string& acceptEncoding, unsigned available){
+    float q[CODING_COUNT] = { -1, -1, -1, -1 };    //-1 表示没有出现过
+    float star = -1;
+    const char* p = acceptEncoding.c_str();
+    const char* end = p + acceptEncoding.size();
+
+    while(p < end){
+        while(p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        const char* name = p;
+        while(p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+        size_t nameLen = p - name;
+
+        float value = 1;
+        while(p < end && *p != ','){
+            if(*p == ';'){
+                p++;
+                while(p < end && (*p == ' ' || *p == '\t')) p++;
+                if(p + 1 < end && (*p == 'q' || *p == 'Q') && p[1] == '='){
+                    value = strtof(p + 2, nullptr);
+                }
+            }
+            else p++;
+        }
+        if(nameLen == 0) continue;
+
+        if(nameLen == 1 && *name == '*'){
+            star = value;
+            continue;
+        }
+        for(int i = IDENTITY; i < CODING_COUNT; i++){
+            if(strlen(NAME[i]) == nameLen && strncasecmp(name, NAME[i], nameLen) == 0){
+                q[i] = value;
+                break;
+            }
+        }
+    }
+
+    for(int i = IDENTITY; i < CODING_COUNT; i++){
+        if(q[i] < 0) q[i] = (star >= 0) ? star : (i == IDENTITY ? 0.001f : 0);
+    }
+
+    static const CODING PREFER[] = { BR, GZIP, DEFLATE, IDENTITY };
+    CODING best = IDENTITY;
+    float bestQ = 0;
+    for(CODING coding : PREFER){
+        if(coding != IDENTITY && !(available & (1u << coding))) continue;
+        if(q[coding] > bestQ){
+            best = coding;
+            bestQ = q[coding];
+        }
+    }
+    return best;
+}
+
+/*gzip 和 HTTP 的 deflate 都是 deflate 流，区别只在外层的头尾：
+windowBits 加 16 输出 gzip 头尾，原样的 15 输出 zlib 头尾（HTTP 的 deflate 指的就是 zlib 格式）。*/
+bool ContentCoding::Compress(const char* data, size_t len, CODING coding, int level, string& out){
+    assert(coding == GZIP || coding == DEFLATE);
+    z_stream zs = { 0 };
+    int windowBits = (coding == GZIP) ? 15 + 16 : 15;
+    if(deflateInit2(&zs, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK){
+        return false;
+    }
+    out.resize(deflateBound(&zs, len));
+    zs.next_in = (Bytef*)data;
+    zs.avail_in = len;
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+bool ContentCoding::GzipFile(const string& src, const string& dst, int level){
+    int srcFd = open(src.data(), O_RDONLY);
+    if(srcFd < 0) return false;
+    struct stat st = { 0 };
+    if(fstat(srcFd, &st) < 0 || st.st_size == 0){
+        close(srcFd);
+        return false;
+    }
+    char* data = (char*)mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
+    close(srcFd);
+    if(data == MAP_FAILED) return false;
+
+    string out;
+    bool ok = Compress(data, st.st_size, GZIP, level, out);
+    munmap(data, st.st_size);
+
+    //压缩后不比原文件小就没必要留副本
+    if(!ok || out.size() >= static_cast<size_t>(st.st_size)) return false;
+
+    string tmp = dst + ".tmp";
+    int dstFd = open(tmp.data(), O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+    if(dstFd < 0) return false;
+    ssize_t len = write(dstFd, out.data(), out.size());
+    close(dstFd);
+    if(len != static_cast<ssize_t>(out.size()) || rename(tmp.data(), dst.data()) < 0){
+        unlink(tmp.data());
+        return false;
+    }
+    return true;
+}
+
+int ContentCoding::PrecompressDir(const string& dir, int level){
+    DIR* dp = opendir(dir.data());
+    if(!dp){
+        LOG_WARN("Precompress: open dir %s error!", dir.data());
+        return 0;
+    }
+    int count = 0;
+    struct dirent* entry;
+    while((entry = readdir(dp)) != nullptr){
+        if(entry->d_name[0] == '.') continue;   //跳过 . .. 以及 .DS_Store 之类的隐藏文件
+        string path = dir + (dir.back() == '/' ? "" : "/") + entry->d_name;
+        struct stat st = { 0 };
+        if(stat(path.data(), &st) < 0) continue;
+        if(S_ISDIR(st.st_mode)){
+            count += PrecompressDir(path, level);
+            continue;
+        }
+        if(!S_ISREG(st.st_mode) || !IsCompressible(path)) continue;
+
+        //副本存在且不比源文件旧就跳过
+        string gz = path + Suffix(GZIP);
+        struct stat gzSt = { 0 };
+        if(stat(gz.data(), &gzSt) == 0 && gzSt.st_mtime >= st.st_mtime) continue;
+        if(GzipFile(path, gz, level)){
+            LOG_DEBUG("Precompress: %s", gz.data());
+            count++;
+        }
+    }
+    closedir(dp);
+    return count;
+}
@@ -0,0 +1,140 @@
+#include "errorpage.h"
+
+using namespace std;
+
+const unordered_map<int, string> ErrorPage::CODE_STATUS = {
+    { 400, "Bad Request" },
+    { 403, "Forbidden" },
+    { 404, "Not Found" },
+    { 405, "Method Not Allowed" },
+    { 503, "Service Unavailable" },
+};
+
+const unordered_map<int, string> ErrorPage::CODE_PATH = {
+    { 400, "/400.html" },
+    { 403, "/403.html" },
+    { 404, "/404.html" },
+    { 405, "/405.html" },
+    { 503, "/503.html" },
+};
+
+//zlib 能生成的编码，br 只来自预压缩副本
+const unsigned ErrorPage::ON_THE_FLY_CODINGS = (1u << ContentCoding::GZIP) | (1u << ContentCoding::DEFLATE);
+
+ErrorPage* ErrorPage::Instance(){
+    static ErrorPage page;
+    return &page;
+}
+
+string ErrorPage::ReadFile_(const string& path){
+    string content;
+    int fd = open(path.data(), O_RDONLY);
+    if(fd < 0) return content;
+    struct stat st = { 0 };
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+        content.resize(st.st_size);
+        size_t done = 0;
+        while(done < content.size()){
+            ssize_t n = read(fd, &content[done], content.size() - done);
+            if(n <= 0) break;
+            done += n;
+        }
+        content.resize(done);
+    }
+    close(fd);
+    return content;
+}
+
+string ErrorPage::Generate_(int code, const string& status, const string& message){
+    string body;
+    body += "<html><title>Error</title>";
+    body += "<body bgcolor=\"ffffff\">";
+    body += to_string(code) + " : " + status + "\n";
+    body += "<p>" + message + "</p>";
+    body += "<hr><em>TinyWebServer</em></body></html>";
+    return body;
+}
+
+void ErrorPage::Init(const string& srcDir){
+    string dir = srcDir;
+    while(!dir.empty() && dir.back() == '/') dir.pop_back();
+    int level = CompressCache::Instance()->GetLevel();
+
+    for(const auto& item : CODE_STATUS){
+        int code = item.first;
+        const string& status = item.second;
+        string body = ReadFile_(dir + CODE_PATH.find(code)->second);
+        if(body.empty()){
+            body = Generate_(code, status, code == 503 ? "Server busy, please retry later." : "File NotFound!");
+        }
+
+        Entry& entry = entries_[code];
+        entry.codings = 0;
+        for(int i = ContentCoding::IDENTITY; i < ContentCoding::CODING_COUNT; i++){
+            ContentCoding::CODING coding = static_cast<ContentCoding::CODING>(i);
+            Page& page = entry.pages[i];
+            page.body.clear();
+            if(coding == ContentCoding::IDENTITY){
+                page.body = body;
+            }
+            else if(!(ON_THE_FLY_CODINGS & (1u << i))
+                    || !CompressCache::Instance()->ShouldCompress(".html", body.size())
+                    || !ContentCoding::Compress(body.data(), body.size(), coding, level, page.body)){
+                page.body.clear();
+                continue;
+            }
+            entry.codings |= 1u << i;
+        }
+
+        //所有编码的正文都压好之后才知道是否有多个变体，有的话每个变体（包括 identity）都要带 Vary
+        bool varies = entry.codings != (1u << ContentCoding::IDENTITY);
+        for(int i = ContentCoding::IDENTITY; i < ContentCoding::CODING_COUNT; i++){
+            if(!(entry.codings & (1u << i))) continue;
+            ContentCoding::CODING coding = static_cast<ContentCoding::CODING>(i);
+            Page& page = entry.pages[i];
+            string common = "Content-type: text/html\r\n";
+            if(code == 405){
+                common += "Allow: GET, HEAD, POST\r\n";
+            }
+            if(code == 503){
+                common += "Retry-After: 1\r\n";
+            }
+            if(coding != ContentCoding::IDENTITY){
+                common += "Content-Encoding: ";
+                common += ContentCoding::Name(coding);
+                common += "\r\n";
+            }
+            if(varies){
+                common += "Vary: Accept-Encoding\r\n";
+            }
+            common += "Content-length: " + to_string(page.body.size()) + "\r\n";
+
+            string statLine = "HTTP/1.1 " + to_string(code) + " " + status + "\r\n";
+            page.header[0] = statLine + "Connection: close\r\n" + common;
+            page.header[1] = statLine + "Connection: keep-alive\r\nkeep-alive: max=6, timeout=120\r\n" + common;
+        }
+    }
+    LOG_INFO("ErrorPage: %d pages prebaked", (int)entries_.size());
+}
+
+const ErrorPage::Page& ErrorPage::Get(int* code, const string& acceptEncoding) const{
+    assert(code && !entries_.empty());
+    auto it = entries_.find(*code);
+    if(it == entries_.end()){
+        *code = 400;
+        it = entries_.find(400);
+    }
+    const Entry& entry = it->second;
+    return entry.pages[ContentCoding::Negotiate(acceptEncoding, entry.codings)];
+}
+
+/*响应头的长度固定，先一次预留好空间，拷贝预制的部分后把 Date 直接写在后面，最后补上空行*/
+void ErrorPage::AppendHeader(const Page& page, bool isKeepAlive, OutputQueue& out){
+    const string& header = page.header[isKeepAlive ? 1 : 0];
+    char* dst = out.Reserve(header.size() + CoarseClock::DATE_HEADER_LEN + 2);
+    memcpy(dst, header.data(), header.size());
+    size_t len = header.size();
+    len += CoarseClock::Instance()->DateHeader(dst + len);
+    memcpy(dst + len, "\r\n", 2);
+    out.Commit(len + 2);
+}
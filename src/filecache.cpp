@@ -0,0 +1,197 @@
+#include "filecache.h"
+
+using namespace std;
+
+FileEntry::FileEntry(const string& srcDir, const string& path, const struct stat& st):
+    checkedMs(CoarseClock::Instance()->NowMs()), srcDir_(srcDir), path_(path)
+{
+    mime_ = MimeType::Of(path_);
+    lastModified_ = CoarseClock::FormatHttpDate(st.st_mtime);
+    char etag[64] = { 0 };
+    snprintf(etag, sizeof(etag), "\"%lx-%lx", (unsigned long)st.st_mtime, (unsigned long)st.st_size);
+    etag_ = etag;   //结尾的引号在拼头块时补上，中间可以插入编码名
+
+    codings_ = 1u << ContentCoding::IDENTITY;
+    file_[ContentCoding::IDENTITY] = srcDir_ + path_;
+    stat_[ContentCoding::IDENTITY] = st;
+    for(int i = ContentCoding::GZIP; i < ContentCoding::CODING_COUNT; i++){
+        ContentCoding::CODING coding = static_cast<ContentCoding::CODING>(i);
+        stat_[i] = { 0 };
+        if(!ContentCoding::Suffix(coding)) continue;
+        string sidecar = file_[ContentCoding::IDENTITY] + ContentCoding::Suffix(coding);
+        if(stat(sidecar.data(), &stat_[i]) == 0 && S_ISREG(stat_[i].st_mode)
+            && stat_[i].st_mtime >= st.st_mtime){
+            codings_ |= 1u << i;
+            file_[i] = sidecar;
+        }
+    }
+    //没有预压缩副本时才考虑运行时压缩
+    if(!Varies() && CompressCache::Instance()->ShouldCompress(path_, st.st_size)){
+        codings_ |= (1u << ContentCoding::GZIP) | (1u << ContentCoding::DEFLATE);
+    }
+
+    for(int i = ContentCoding::IDENTITY; i < ContentCoding::CODING_COUNT; i++){
+        ContentCoding::CODING coding = static_cast<ContentCoding::CODING>(i);
+        bundled_[i] = nullptr;
+        built_[i].store(false, memory_order_relaxed);
+        if(!file_[i].empty()){
+            bundled_[i] = ResourceBundle::Instance()->FindFresh(path_ + ContentCoding::Suffix(coding), stat_[i]);
+            header_[i] = MakeHeader_(coding, stat_[i].st_size);
+            built_[i].store(true, memory_order_relaxed);
+        }
+        else if(codings_ & (1u << i)){
+            headHeader_[i] = MakeHeader_(coding, -1);
+        }
+    }
+}
+
+string FileEntry::MakeHeader_(ContentCoding::CODING coding, long long len) const{
+    string header = "HTTP/1.1 200 OK\r\n";
+    header += "Content-type: " + string(mime_) + "\r\n";
+    if(len >= 0){
+        header += "Content-length: " + to_string(len) + "\r\n";
+    }
+    header += "Last-Modified: " + lastModified_ + "\r\n";
+    header += "ETag: " + etag_;
+    if(coding != ContentCoding::IDENTITY){
+        header += "-";
+        header += ContentCoding::Name(coding);
+    }
+    header += "\"\r\n";
+    if(coding != ContentCoding::IDENTITY){
+        header += "Content-Encoding: ";
+        header += ContentCoding::Name(coding);
+        header += "\r\n";
+    }
+    if(Varies()){
+        header += "Vary: Accept-Encoding\r\n";
+    }
+    return header;
+}
+
+/*运行时压缩的编码在第一次用到时才压缩：原文件的 version 由 inode、大小和修改时间组成，
+压缩结果同时放在 CompressCache 和条目里，条目存活期间不会因为缓存淘汰而重新压缩。*/
+const string& FileEntry::Header(ContentCoding::CODING coding) const{
+    assert(codings_ & (1u << coding));
+    if(!file_[coding].empty()) return header_[coding];
+
+    call_once(once_[coding], [this, coding]{
+        const struct stat& st = stat_[ContentCoding::IDENTITY];
+        char version[64] = { 0 };
+        snprintf(version, sizeof(version), "%lx-%lx-%lx.%lx",
+                    (unsigned long)st.st_ino, (unsigned long)st.st_size,
+                    (unsigned long)st.st_mtim.tv_sec, (unsigned long)st.st_mtim.tv_nsec);
+        const string& file = file_[ContentCoding::IDENTITY];
+        size_t len = st.st_size;
+        encoded_[coding] = CompressCache::Instance()->Get(path_, version, coding, [&file, len, coding](string& out){
+            int fd = open(file.data(), O_RDONLY);
+            if(fd < 0) return false;
+            char* data = (char*)mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if(data == MAP_FAILED) return false;
+            bool ok = ContentCoding::Compress(data, len, coding, CompressCache::Instance()->GetLevel(), out);
+            munmap(data, len);
+            return ok;
+        });
+        if(encoded_[coding]){
+            header_[coding] = MakeHeader_(coding, encoded_[coding]->size());
+        }
+        built_[coding].store(true, memory_order_release);
+    });
+    return header_[coding];
+}
+
+/*HEAD 只要响应头，不应该为了 Content-length 去读文件、压缩整个内容。运行时压缩的编码已经有结果时用真实的头块，
+否则用不带 Content-length 的头块；压缩失败时 header_ 为空串，调用方和 GET 一样退回原文件。*/
+const string& FileEntry::HeadHeader(ContentCoding::CODING coding) const{
+    assert(codings_ & (1u << coding));
+    if(built_[coding].load(memory_order_acquire)) return header_[coding];
+    return headHeader_[coding];
+}
+
+CompressCache::Result FileEntry::Encoded(ContentCoding::CODING coding) const{
+    if(!file_[coding].empty()) return nullptr;
+    Header(coding);
+    return encoded_[coding];
+}
+
+bool FileEntry::IsFresh() const{
+    struct stat st = { 0 };
+    const struct stat& old = stat_[ContentCoding::IDENTITY];
+    if(stat(file_[ContentCoding::IDENTITY].data(), &st) < 0
+        || st.st_ino != old.st_ino || st.st_size != old.st_size
+        || st.st_mtim.tv_sec != old.st_mtim.tv_sec || st.st_mtim.tv_nsec != old.st_mtim.tv_nsec
+        || !(st.st_mode & S_IROTH)){
+        return false;
+    }
+    //副本新增、删除或被重新生成也要重建
+    for(int i = ContentCoding::GZIP; i < ContentCoding::CODING_COUNT; i++){
+        ContentCoding::CODING coding = static_cast<ContentCoding::CODING>(i);
+        if(!ContentCoding::Suffix(coding)) continue;
+        bool had = !file_[i].empty();
+        bool has = stat((file_[ContentCoding::IDENTITY] + ContentCoding::Suffix(coding)).data(), &st) == 0
+                    && S_ISREG(st.st_mode) && st.st_mtime >= old.st_mtime;
+        if(had != has || (has && st.st_mtim.tv_sec != stat_[i].st_mtim.tv_sec)) return false;
+    }
+    return true;
+}
+
+FileCache::FileCache(){
+    checkIntervalMs_ = 1000;
+}
+
+FileCache* FileCache::Instance(){
+    static FileCache cache;
+    return &cache;
+}
+
+void FileCache::Init(int checkIntervalMs){
+    assert(checkIntervalMs >= 0);
+    lock_guard<mutex> locker(mtx_);
+    checkIntervalMs_ = checkIntervalMs;
+}
+
+/*命中且在检查间隔内直接返回，超过间隔重新 stat 一次确认文件没变；
+文件不存在、是目录或不可读时不缓存，由调用方走错误页的流程。*/
+FileCache::EntryPtr FileCache::Get(const string& srcDir, const string& path, int* code){
+    assert(code);
+    EntryPtr entry;
+    {
+        lock_guard<mutex> locker(mtx_);
+        auto it = cache_.find(path);
+        if(it != cache_.end()) entry = it->second;
+    }
+    if(entry && entry->SrcDir() == srcDir){
+        long long now = CoarseClock::Instance()->NowMs();
+        if(now - entry->checkedMs < checkIntervalMs_ || entry->IsFresh()){
+            entry->checkedMs = now;
+            *code = 200;
+            return entry;
+        }
+    }
+
+    entry = Load_(srcDir, path, code);
+    lock_guard<mutex> locker(mtx_);
+    if(entry) cache_[path] = entry;
+    else cache_.erase(path);
+    return entry;
+}
+
+FileCache::EntryPtr FileCache::Load_(const string& srcDir, const string& path, int* code){
+    struct stat st = { 0 };
+    if(stat((srcDir + path).data(), &st) < 0 || S_ISDIR(st.st_mode)){
+        *code = 404;
+        return nullptr;
+    }
+    if(!(st.st_mode & S_IROTH)){
+        *code = 403;
+        return nullptr;
+    }
+    *code = 200;
+    return make_shared<const FileEntry>(srcDir, path, st);
+}
+
+void FileCache::Clear(){
+    lock_guard<mutex> locker(mtx_);
+    cache_.clear();
+}
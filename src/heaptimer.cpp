@@ -58,12 +58,12 @@ void HeapTimer::add(int id, int timeout, const TimeoutCallBack& cb){
         //新节点，堆尾插入，调整堆
         i = heap_.size();
         ref_[id] = i;
-        heap_.push_back({id, Clock::now() + MS(timeout), cb});
+        heap_.push_back({id, CoarseClock::Instance()->Now() + MS(timeout), cb});
         siftup_(i);
     }else{
         //已有节点
         i = ref_[id];
-        heap_[i].expires = Clock::now() + MS(timeout);
+        heap_[i].expires = CoarseClock::Instance()->Now() + MS(timeout);
         heap_[i].cb = cb;
         if(!siftdown_(i, heap_.size()))
             siftup_(i);
@@ -100,7 +100,7 @@ void HeapTimer::del_(size_t index){
 void HeapTimer::adjust(int id, int timeout){
     //更新指定节点的超时时间
     assert(!heap_.empty() && ref_.count(id) > 0);
-    heap_[ref_[id]].expires = Clock::now() + MS(timeout);
+    heap_[ref_[id]].expires = CoarseClock::Instance()->Now() + MS(timeout);
     siftdown_(ref_[id], heap_.size());
 }
 
@@ -112,7 +112,7 @@ void HeapTimer::tick(){
         /*这行代码是计算当前时间与定时器节点过期时间之间的时间差，然后将其转换为毫秒（MS是毫秒的std::chrono::duration类型别名），
         最后检查时间差是否大于0，以判断该定时器节点是否已经过期。如果时间差大于0，表示该定时器节点还未过期，不需要继续处理；
         如果时间差小于等于0，表示该定时器节点已经过期，需要执行回调函数并将其从定时器堆中删除。*/
-        if(std::chrono::duration_cast<MS>(node.expires - Clock::now()).count() > 0) break;
+        if(std::chrono::duration_cast<MS>(node.expires - CoarseClock::Instance()->Now()).count() > 0) break;
         node.cb();
         pop();
     }
@@ -136,7 +136,7 @@ int HeapTimer::GetNextTick(){
     tick();
     size_t res = -1;
     if(!heap_.empty()){
-        res = std::chrono::duration_cast<MS>(heap_.front().expires - Clock::now()).count();
+        res = std::chrono::duration_cast<MS>(heap_.front().expires - CoarseClock::Instance()->Now()).count();
         if(res < 0) res = 0;
     }
     return res;
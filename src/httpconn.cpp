@@ -9,6 +9,7 @@ HttpConn::HttpConn(){
     fd_ = -1;
     addr_ = { 0 };
     isClosed_ = true; 
+    tasks_ = 0;
 }
 
 HttpConn::~HttpConn(){
@@ -20,14 +21,21 @@ void HttpConn::init(int fd, const sockaddr_in& addr){
     userCount++;
     fd_ = fd;
     addr_ = addr;
-    writeBuff_.RetrieveAll();
-    readBuff_.RetrieveAll();
+    //上一个连接留下的缓冲在这里释放，见 Close
+    output_.Clear();
+    readBuff_.Shrink();
+    if(OutputQueue::ZeroCopyThreshold() > 0){
+        int on = 1;
+        output_.EnableZeroCopy(setsockopt(fd_, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0);
+    }
     isClosed_ = false;
     LOG_INFO("Client[%d](%s:%d), userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
 }
 
+/*关闭时不释放缓冲：定时器的关闭回调在事件循环线程里执行，这时工作线程可能还在 OnRead_、OnWrite_ 里使用这个连接，
+块还回内存池后会被别的连接拿去。读缓冲的块、输出队列持有的文件和缓存引用留到连接对象下次 init 时，在事件循环线程里释放；
+对象析构时由成员自己释放。*/
 void HttpConn::Close(){
-    response_.UnmapFile();
     if(isClosed_ == false){
         isClosed_ = true;
         userCount--;
@@ -36,6 +44,32 @@ void HttpConn::Close(){
     }
 }
 
+/*只在事件循环线程调用。任务计数为 0 时没有工作线程在用这个连接，而新任务也只能由事件循环提交，
+这时释放缓冲是安全的；acquire 保证看到最后一个任务对缓冲和 isClosed_ 的修改。
+已关闭的连接不必等到下次 init，缓冲在这里就还回内存池。*/
+void HttpConn::ReleaseIdle(){
+    if(tasks_.load(memory_order_acquire) != 0) return;
+    if(isClosed_){
+        output_.Clear();
+        readBuff_.Shrink();
+        return;
+    }
+    readBuff_.ReleaseIdle();
+}
+
+/*零拷贝的完成通知以 EPOLLERR 的形式到达。SO_ERROR 为 0 说明只是错误队列里有通知，连接本身没有出错。*/
+bool HttpConn::ReapZeroCopy(){
+    if(!output_.ZeroCopyEnabled()) return false;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if(getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0){
+        return false;
+    }
+    int count = output_.ReapZeroCopy(fd_);
+    LOG_DEBUG("Client[%d] zerocopy reaped %d, pending %d", fd_, count, (int)output_.ZeroCopyPending());
+    return true;
+}
+
 int HttpConn::GetFD() const{
     return fd_;
 }
@@ -64,31 +98,33 @@ ssize_t HttpConn::read(int* saveError){
     return len;
 }
 
-/*这段代码是在实现Http服务器的socket写入数据的功能，具体作用是将写缓冲区中的数据使用writev()函数写入socket中，
-同时根据写入字节数更新缓冲区中iov_的指针和长度，直到写入完成或缓冲区空间不足。其中，如果缓冲区中第一个iovec中的数据写入完成，则会将其清空。
+/*503 的响应在启动时已经预制好，这里只拼上 Date，正文引用预制的内存，只尝试写一次：
+响应很小，一般一次就能放进发送缓冲区；写不完也不再等，连接马上会被关闭。
+先把已经到达的请求读掉，避免关闭时接收缓冲区里还有数据导致内核直接发 RST，客户端收不到 503。*/
+void HttpConn::Shed(){
+    int saveError = 0;
+    read(&saveError);
+    readBuff_.RetrieveAll();
+    output_.Clear();
+    int code = 503;
+    const ErrorPage::Page& page = ErrorPage::Instance()->Get(&code, "");
+    ErrorPage::AppendHeader(page, false, output_);
+    output_.AppendRef(page.body.data(), page.body.size());
+    output_.WriteFd(fd_, &saveError);
+    output_.Clear();
+}
+
+/*这段代码是在实现Http服务器的socket写入数据的功能，具体作用是把输出队列中的片段成批写入socket中，
+队列按实际写出的字节数前移，写完的片段立即释放，直到写入完成或发送缓冲区已满。
 同时，为了保证高效率，这段代码使用了do-while循环，判断是否是ET模式，以及待写入数据的长度是否超过了一定的阈值（10240字节），以避免出现性能问题。该函数返回写入socket中的字节数。*/
 ssize_t HttpConn::write(int* saveError){
     ssize_t len = -1;
     do{
-        len = writev(fd_, iov_, iovCnt_);
+        len = output_.WriteFd(fd_, saveError);
         if(len <= 0){
-            *saveError = errno;
             break;
         }
-        if(iov_[0].iov_len + iov_[1].iov_len == 0) break; //传输结束
-        else if(static_cast<size_t>(len) > iov_[0].iov_len){
-            iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if(iov_[0].iov_len){
-                writeBuff_.RetrieveAll();
-                iov_[0].iov_len = 0;
-            }
-        }
-        else{
-            iov_[0].iov_base = (uint8_t* )iov_[0].iov_base + len;
-            iov_[0].iov_len -= len;
-            writeBuff_.Retrieve(len);
-        }
+        if(output_.Empty()) break; //传输结束
     }while(isET || ToWriteBytes() > 10240);
     return len;
 }
@@ -101,43 +137,33 @@ ssize_t HttpConn::write(int* saveError){
 
 调用HTTP请求对象request_的解析函数parse()对读缓冲区readBuff_进行解析，解析成功则初始化HTTP响应对象response_，响应状态码为200；否则初始化HTTP响应对象response_，响应状态码为400。
 
-调用HTTP响应对象response_的MakeResponse()函数生成HTTP响应报文，写入写缓冲区writeBuff_。
-
-填充IO向量结构iov_，iov_[0]指向写缓冲区writeBuff_，iov_[1]指向HTTP响应对象response_的文件数据（如果有文件的话）。
+调用HTTP响应对象response_的MakeResponse()函数把响应头、正文（缓存的内存或文件）依次追加到输出队列output_。
 
 返回true表示处理成功，可以进行写操作。
 
 
 */
 bool HttpConn::process(){
+    static const string ACCEPT_ENCODING = "Accept-Encoding";
     request_.Init();
     if(readBuff_.ReadableBytes() <= 0){
         return false;
     }
-    else if(request_.parse(readBuff_)){
+    size_t before = readBuff_.ReadableBytes();
+    bool parsed = request_.parse(readBuff_);
+    readBuff_.NoteMessageSize(before - readBuff_.ReadableBytes());
+    if(parsed){
         LOG_DEBUG("%s", request_.path().c_str());
-        response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
+        response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), request_.IsMethodAllowed() ? 200 : 405);
+        response_.SetAcceptEncoding(request_.GetHeader(ACCEPT_ENCODING));
+        response_.SetHeadOnly(request_.IsHead());
     }
     else{
         
         response_.Init(srcDir, request_.path(), false, 400);
     }
 
-    response_.MakeResponse(writeBuff_);
-
-    //响应头
-
-    iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
-    iov_[0].iov_len = writeBuff_.ReadableBytes();
-    iovCnt_ = 1;
-
-    //文件
-
-    if(response_.FileLen() > 0 && response_.File()){
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();
-        iovCnt_ = 2;
-    }
-    LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen() , iovCnt_, ToWriteBytes());
+    response_.MakeResponse(output_);
+    LOG_DEBUG("to write %d", (int)ToWriteBytes());
     return true;
 }
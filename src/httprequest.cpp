@@ -25,13 +25,24 @@ bool HttpRequest::IsKeepAlive() const{
     return false;
 }
 
-bool HttpRequest::parse(Buffer& buff){
-    const char CRLF[] = "\r\n"; //http报头每行的结尾
-    if(buff.ReadableBytes() < 0){
-        return false;
-    }
+bool HttpRequest::IsHead() const{
+    return method_ == "HEAD";
+}
+
+bool HttpRequest::IsMethodAllowed() const{
+    return method_ == "GET" || method_ == "HEAD" || method_ == "POST";
+}
+
+/*直接在读缓冲区的第一块上找行尾，跨块的行由 FindCRLF() 拼到第一块中；
+没有 "\r\n" 时（例如请求体）剩下的数据整体作为一行。*/
+bool HttpRequest::parse(ChainBuffer& buff){
     while(buff.ReadableBytes() && state_ != FINISH){
-        const char* lineEd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2); //找到每行结尾
+        const char* lineEd = buff.FindCRLF(); //找到每行结尾
+        bool hasCRLF = lineEd != nullptr;
+        if(!hasCRLF){
+            buff.Pullup(buff.ReadableBytes());
+            lineEd = buff.PeekEnd();
+        }
         std::string line(buff.Peek(), lineEd); //解析每行
         switch (state_)
         {
@@ -52,7 +63,7 @@ bool HttpRequest::parse(Buffer& buff){
         default:
             break;
         }
-        if(lineEd == buff.BeginWrite()) break;
+        if(!hasCRLF) break;
         buff.RetrieveUntil(lineEd + 2);
     }
     LOG_DEBUG("[%s]","[%s]", "[%s]", method_.c_str(), path_.c_str(), version_.c_str());
@@ -113,6 +124,11 @@ int HttpRequest::ConverHex(char ch){
     if(ch >= 'a' && ch <= 'f') return ch - 'A' + 10;
 }
 
+bool HttpRequest::MayBlock(const char* begin, const char* end){
+    static const char POST[] = "POST ";
+    return static_cast<size_t>(end - begin) >= sizeof(POST) - 1 && memcmp(begin, POST, sizeof(POST) - 1) == 0;
+}
+
 void HttpRequest::ParsePost_(){
     if(method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded"){//表单格式
         ParseFromUrlencoded_();
@@ -275,4 +291,14 @@ std::string HttpRequest::GetPost(const char* key) const {
         return post_.find(key)->second;
     }
     return "";
+}
+
+const std::string& HttpRequest::GetHeader(const std::string& key) const{
+    static const std::string EMPTY;
+    assert(key != "");
+    auto it = header_.find(key);
+    if(it != header_.end()){
+        return it->second;
+    }
+    return EMPTY;
 }
\ No newline at end of file
@@ -2,177 +2,117 @@
 
 using namespace std;
 
-const unordered_map<string, string> HttpResponse::SUFFIX_TYPE = {
-    {".html",   "text/html"},
-    {".xml",    "text/xml"},
-    {".xhtml",  "application/xhtml+xml"},
-    {".txt",    "text/plain"},
-    {".rtf",    "application/rtf"},
-    {".pdf",    "application/pdf"},
-    {".word",   "application/nsword"},
-    {".png",    "image/png"},
-    { ".gif",   "image/gif" },
-    { ".jpg",   "image/jpeg" },
-    { ".jpeg",  "image/jpeg" },
-    { ".au",    "audio/basic" },
-    { ".mpeg",  "video/mpeg" },
-    { ".mpg",   "video/mpeg" },
-    { ".avi",   "video/x-msvideo" },
-    { ".gz",    "application/x-gzip" },
-    { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
-};
-
-const unordered_map<int, string> HttpResponse::CODE_STATUS = {
-    { 200, "OK" },
-    { 400, "Bad Request" },
-    { 403, "Forbidden" },
-    { 404, "Not Found" },
-};
-
-const unordered_map<int, string> HttpResponse::CODE_PATH = {
-    { 400, "/400.html" },
-    { 403, "/403.html" },
-    { 404, "/404.html" },
-};
-
 HttpResponse::HttpResponse(){
     code_ = -1;
-    path_ = srcDir_ = "";
+    path_ = srcDir_ = acceptEncoding_ = "";
+    coding_ = ContentCoding::IDENTITY;
     isKeepAlive_ = false;
-    mmFile_ = nullptr;
-    mmFileStat_ = { 0 };
-}
-
-HttpResponse::~HttpResponse() {
-    UnmapFile();
+    headOnly_ = false;
 }
 
 void HttpResponse::Init(const std::string& srcDir, std::string& path, bool isKeepAlive, int code){
     assert(srcDir != "");
-    if(mmFile_) { UnmapFile(); }
     code_ = code;
     isKeepAlive_ = isKeepAlive;
     srcDir_ = srcDir;
     path_ = path;
-    mmFile_ = nullptr;
-    mmFileStat_ = { 0 };
+    acceptEncoding_ = "";
+    coding_ = ContentCoding::IDENTITY;
+    headOnly_ = false;
 }
 
-void HttpResponse::MakeResponse(Buffer& buff){
-    //请求的资源文件执行相反的操作，
-    if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)){ //S_ISDIR(st_mode)        是否为目录
-        code_ = 404;
-    }
-    else if(!(mmFileStat_.st_mode & S_IROTH)){  //判断文件类型时，用对文件的st_mode的值与上面给出的值相与，再比较。
-        code_ = 403;
-    }
-    else if(code_ == -1){
-        code_ = 200;
-    }
-    ErrorHtml_();
-    AddStatLine_(buff);
-    AddHeader_(buff);
-    AddContent_(buff);
-}
-
-char* HttpResponse::File(){
-    return mmFile_;
+void HttpResponse::SetAcceptEncoding(const std::string& acceptEncoding){
+    acceptEncoding_ = acceptEncoding;
 }
 
-size_t HttpResponse::FileLen() const{
-    return mmFileStat_.st_size;
+void HttpResponse::SetHeadOnly(bool headOnly){
+    headOnly_ = headOnly;
 }
 
-void HttpResponse::ErrorHtml_(){
-    if(CODE_PATH.count(code_) == 1){
-        path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);
+/*200 响应直接引用 FileCache 里预先拼好的头块；403、404、400、405 等错误使用 ErrorPage 启动时预制好的响应。
+响应的各个部分按顺序放进连接的输出队列：头块、正文都只是引用，不拷贝；磁盘上的文件用 sendfile 发送。
+HEAD 请求只发送响应头，长度等信息都来自缓存的元数据，不会打开文件，也不会触发运行时压缩。*/
+void HttpResponse::MakeResponse(OutputQueue& out){
+    FileCache::EntryPtr entry;
+    if(code_ == 200 || code_ == -1){
+        int code = 200;
+        entry = FileCache::Instance()->Get(srcDir_, path_, &code);
+        code_ = code;
     }
-}
-
-void HttpResponse::AddStatLine_(Buffer& buff){
-    string status;
-    if(CODE_STATUS.count(code_) == 1){
-        status = CODE_STATUS.find(code_)->second;
-    }
-    else{
-        code_ = 400;
-        status = CODE_STATUS.find(400)->second;
+    if(code_ == 200 && AddCachedResponse_(entry, out)){
+        return;
     }
-    buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n");
-}
-
-void HttpResponse::AddHeader_(Buffer& buff){
-    buff.Append("Connection: ");
-    if(isKeepAlive_){
-        buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
+    if(code_ == 200){   //stat 之后文件被删除或无法打开
+        code_ = 404;
     }
-    else{
-        buff.Append("close\r\n");
+    coding_ = ContentCoding::IDENTITY;
+    const ErrorPage::Page& page = ErrorPage::Instance()->Get(&code_, acceptEncoding_);
+    ErrorPage::AppendHeader(page, isKeepAlive_, out);
+    if(!headOnly_){
+        out.AppendRef(page.body.data(), page.body.size());
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
 }
 
-void HttpResponse::AddContent_(Buffer& buff){
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
-    if(srcFd < 0){
-        ErrorContent(buff, "File NotFound!");
-        return ;
+/*按 Accept-Encoding 在条目可用的编码中挑选一个，先打开要发送的文件（或取得运行时压缩的结果），
+成功后再引用整块响应头，只补上 Connection、Date 和结尾的空行。打开失败时什么都不写，返回 false 交给错误流程。
+引用的头块和压缩结果由队列持有 entry、encoded，发送完之前不会被释放。*/
+bool HttpResponse::AddCachedResponse_(const FileCache::EntryPtr& entry, OutputQueue& out){
+    assert(entry);
+    coding_ = entry->Varies() ? ContentCoding::Negotiate(acceptEncoding_, entry->Codings()) : ContentCoding::IDENTITY;
+    const string* header = headOnly_ ? &entry->HeadHeader(coding_) : &entry->Header(coding_);
+    if(header->empty()){    //运行时压缩失败，退回原文件
+        coding_ = ContentCoding::IDENTITY;
+        header = &entry->Header(coding_);
     }
 
-    //将文件映射到内存提高文件的访问速度，MAP_PRIVATE；建立一个写入时拷贝的私有映射
-    LOG_DEBUG("file path: %s", (srcDir_ + path_).data());
-    int* mmRet = (int* )mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1){
-        ErrorContent(buff, "File NotFound!");
-        return ;
+    const string& file = entry->File(coding_);
+    size_t size = entry->Stat(coding_).st_size;
+    CompressCache::Result encoded;
+    const char* bundled = nullptr;
+    int srcFd = -1;
+    if(headOnly_){
+        //响应头已经包含了 Content-length，不需要文件内容
     }
-    mmFile_ = (char*)mmRet;
-    close(srcFd);
-    buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
-}
-
-
-
-
-void HttpResponse::UnmapFile(){
-    if(mmFile_){
-        munmap(mmFile_, mmFileStat_.st_size); //munmap删除特定地址区域的对象映射。
-        mmFile_ = nullptr;
+    else if(file.empty()){
+        encoded = entry->Encoded(coding_);
     }
-}
-
-string HttpResponse::GetFileType_(){
-    string::size_type idx = path_.find_last_of('.');
-    if(idx == string::npos){
-        return "text/plain";
+    else if(entry->Bundled(coding_)){
+        bundled = entry->Bundled(coding_);
     }
-    string suffix = path_.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1){
-        return SUFFIX_TYPE.find(suffix)->second;
+    else if(size > 0){
+        srcFd = open(file.data(), O_RDONLY);
+        if(srcFd < 0){
+            coding_ = ContentCoding::IDENTITY;
+            return false;
+        }
     }
-    return "text/plain";
-}
+    LOG_DEBUG("file path: %s", file.data());
 
-void HttpResponse::ErrorContent(Buffer& buff, string message){
-    string body;
-    string status;
-    body += "<html><title>Error</title>";
-    body += "<body bgcolor=\"ffffff\">";
-    if(CODE_STATUS.count(code_) == 1){
-        status = CODE_STATUS.find(code_)->second;
+    out.AppendRef(header->data(), header->size(), entry);
+    AddTail_(out);
+    if(encoded){
+        out.AppendRef(encoded->data(), encoded->size(), encoded);
     }
-    else{
-        status = "Bad requst";
+    else if(bundled){
+        out.AppendRef(bundled, size);   //预加载的内存在进程退出前一直有效
     }
+    else if(srcFd >= 0){
+        out.AppendFile(srcFd, 0, size);
+    }
+    return true;
+}
 
-    body += to_string(code_) + " : " + status + "\n";
-    body += "<p>" + message +"<\p>";
-    body += "<hr><em>TinyWebServer</em></body></html>";
-
-    buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n");
-    buff.Append(body);
-}
\ No newline at end of file
+//Connection、Date 和结尾的空行一次写进队列；Date 来自 CoarseClock 缓存的字符串
+void HttpResponse::AddTail_(OutputQueue& out){
+    static const char KEEP_ALIVE[] = "Connection: keep-alive\r\nkeep-alive: max=6, timeout=120\r\n";
+    static const char CLOSE[] = "Connection: close\r\n";
+    const char* conn = isKeepAlive_ ? KEEP_ALIVE : CLOSE;
+    size_t connLen = isKeepAlive_ ? sizeof(KEEP_ALIVE) - 1 : sizeof(CLOSE) - 1;
+
+    char* dst = out.Reserve(connLen + CoarseClock::DATE_HEADER_LEN + 2);
+    memcpy(dst, conn, connLen);
+    size_t len = connLen;
+    len += CoarseClock::Instance()->DateHeader(dst + len);
+    memcpy(dst + len, "\r\n", 2);
+    out.Commit(len + 2);
+}
@@ -1,71 +1,100 @@
 #include "log.h"
 using namespace std;
 
+const size_t Log::RING_SIZE;
+const int Log::FLUSH_INTERVAL_MS;
+const int Log::SIZE_MAX_AGE_MS;
+
 Log::Log(){
     lineCount_ = 0;
+    fileIndex_ = 0;
     isAsync_ = false;
     toDay_ = 0;
     writeThread_ = nullptr;
-    deque_ = nullptr;
-    fp_ = nullptr;
+    fd_ = -1;
+    outLen_ = 0;
+    outLines_ = 0;
+    flushPolicy_ = ON_LEVEL;
+    flushValue_ = 3;
+    wakePending_ = false;
+    flushNow_ = false;
+    isClosing_ = false;
+    drainReq_ = 0;
+    drainDone_ = 0;
 }
 
 Log::~Log(){
     /*这段代码的作用是：
     检查是否有写线程(writeThread_)，并且该线程可以被join，即该线程还没有被join过；
-    如果满足条件，就通过循环清空双端队列(deque_)中的元素，即把队列中的所有数据都写入到日志文件中；
-    然后关闭队列，停止队列的读写操作；
+    如果满足条件，就通知写线程退出，写线程退出前会把所有暂存环和自己缓冲里剩下的日志写进文件；
     最后等待写线程完成任务，即等待写线程结束并退出。
-    综上，这段代码的作用是等待写线程完成任务，并确保队列中的所有数据都被写入到日志文件中。*/
-    if(writeThread_ && writeThread_->joinable()){         
-        while(!deque_->empty()){
-            deque_->flush();
+    之后再写的日志（比如其他静态对象析构时）走同步路径直接写文件。*/
+    if(writeThread_ && writeThread_->joinable()){
+        isClosing_ = true;
+        {
+            lock_guard<mutex> locker(wakeMtx_);
+            wakeCond_.notify_one();
         }
-        deque_->Close();
         writeThread_->join();
     }
-    if(fp_){                //关闭文件
+    if(fd_ >= 0){           //关闭文件
         lock_guard<mutex> locker(mtx_);
-        flush();            //刷新缓冲区
-        fclose(fp_);
+        close(fd_);
+        fd_ = -1;
     }
 }
 
+bool Log::SetAffinity(const vector<int>& cpus){
+    if(!writeThread_) return false;
+    return Affinity::Pin(writeThread_->native_handle(), cpus);
+}
+
+//每条日志都要判断等级，等级改成原子变量，不再加锁
 int Log::GetLevel(){
-    lock_guard<mutex> locker(mtx_);
-    return level_;
+    return level_.load(memory_order_relaxed);
 }
 
 void Log::SetLevel(int level){
-    lock_guard<mutex> locker(mtx_);
-    level_ = level;
+    level_.store(level, memory_order_relaxed);
+}
+
+//INTERVAL、SIZE 的 value 不合法时退回默认的 ON_LEVEL；SIZE 不超过写线程的缓冲大小
+void Log::SetFlushPolicy(FLUSH_POLICY policy, int value){
+    if((policy == INTERVAL || policy == SIZE) && value <= 0){
+        policy = ON_LEVEL;
+        value = 3;
+    }
+    if(policy == SIZE && static_cast<size_t>(value) > OUT_BUFFER_SIZE){
+        value = static_cast<int>(OUT_BUFFER_SIZE);
+    }
+    flushValue_.store(value, memory_order_relaxed);
+    flushPolicy_.store(policy, memory_order_relaxed);
+    WakeWriter_();      //写线程按新的间隔重新计算等待时间
 }
 
 void Log::init(int level = 1, const char* path, const char* suffix, int maxQueueCapacity){
+    //重新 init 时各线程的环里可能还有按旧配置写下的日志，先让写线程把它们写进旧文件
+    Drain_();
     isOpen_ = true;
     level_ = level;
-    /*如果最大容量大于0，表示需要异步记录，将isAsync_设置为true，并创建一个BlockDeque类型的队列，
-    并通过unique_ptr将其移动到类成员变量deque_中。同时，创建一个新线程，并通过unique_ptr将其移动到类成员变量writeThread_中，并调用该线程的入口函数FlushLogThread。
+    /*如果最大容量大于0，表示需要异步记录，将isAsync_设置为true，并创建写线程，通过unique_ptr将其移动到类成员变量writeThread_中，并调用该线程的入口函数FlushLogThread。
+    异步模式下每个线程第一次写日志时才创建自己的暂存环，大小固定为 RING_SIZE，maxQueueCapacity 只用来决定是否异步。
     如果最大容量等于或小于0，则不需要异步记录，将isAsync_设置为false。
     */
     if(maxQueueCapacity > 0){
         isAsync_ = true;
-        if(!deque_){
+        if(!writeThread_){
+            out_.reset(new char[OUT_BUFFER_SIZE]);
             /*
             上述代码中，std::move()函数用于将右值（例如临时创建的对象）转移给另一个对象，而不是进行传统的复制操作，这样可以避免不必要的内存拷贝，从而提高程序的效率。
             在代码中，std::unique_ptr类型的对象在移动时，它所管理的指针会被设置为nullptr，以避免悬空指针的出现。因此，通过使用std::move()函数，可以实现对象的移动而非复制。*/
-            unique_ptr<BlockDeque<std::string>> newDeque(new BlockDeque<std::string>);
-            deque_ = move(newDeque);
-
             std::unique_ptr<std::thread> newThread(new thread(FlushLogThread));
             writeThread_ = move(newThread);
-            
+
         }
     }else{
         isAsync_ = false;
     }
-    
-    lineCount_ = 0;
 
     /*
     这段代码获取了当前时间并生成日志文件的文件名，具体解释如下：
@@ -73,161 +102,326 @@ void Log::init(int level = 1, const char* path, const char* suffix, int maxQueue
     time(nullptr) 获取当前时间（自1970年1月1日以来的秒数）。
     localtime(&timer) 把时间戳转换成当前时区的时间，返回一个指向结构体 tm 的指针。
     struct tm t = *sysTime 将 tm 结构体复制到 t 变量中。
-    snprintf(filename, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_) 
+    snprintf(filename, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_)
     使用 snprintf 函数格式化字符串生成日志文件名，其中 %04d 表示年份占4位，不足位数用0填充；%02d 表示月份和日期占2位，不足位数用0填充；%s 表示后缀名；
     LOG_NAME_LEN 是文件名的最大长度。
     toDay_ = t.tm_mday 把当前日期保存在 toDay_ 变量中。*/
-    
+
     time_t timer = time(nullptr);
     struct tm *sysTime = localtime(&timer);
     struct tm t = *sysTime;
     //std::cout << "debug" << std::endl;
-    path_ = path;
-    suffix_ = suffix;
     char filename[LOG_NAME_LEN] = {0};
     snprintf(filename, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s",
-        path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
-    toDay_ = t.tm_mday;
+        path, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix);
 
     /*这样加一个大括号并没有改变原有的代码逻辑，只是将一段代码用一对大括号括起来，形成了一个代码块（Block），使这段代码形成了一个作用域。
     这样做的目的是为了在这个代码块结束后，自动销毁 lock_guard 对象，从而解锁 mtx_，避免锁的过期时间过长，提高并发性能。*/
     {
-        /*这段代码主要是在初始化Log对象时创建日志文件，并初始化缓冲区。具体做法是先清空缓冲区（buff_.RetrieveAll()），
-        然后尝试关闭并重新打开日志文件（先通过fclose关闭，再通过fopen重新打开），
+        /*这段代码主要是在初始化Log对象时创建日志文件。具体做法是
+        先关闭之前的文件，再以追加方式打开新文件，
         如果打开文件失败则尝试创建文件所在目录，并再次尝试打开文件。如果最终打开文件失败，则通过assert断言抛出异常。lock_guard用于保证多线程情况下对于同一Log对象的初始化操作是线程安全的。*/
         lock_guard<mutex> locker(mtx_);
-        buff_.RetrieveAll();
-        if(fp_){
-            flush();
-            fclose(fp_);
+        if(fd_ >= 0){
+            close(fd_);
         }
+        //路径和行数由 Rotate_ 在锁内读写，和文件一起切换
+        path_ = path;
+        suffix_ = suffix;
+        toDay_ = t.tm_mday;
+        lineCount_ = 0;
+        fileIndex_ = 0;
 
-        fp_ = fopen(filename, "a");
-        if(fp_ == nullptr){
+        fd_ = OpenFile_(filename);
+        if(fd_ < 0){
             mkdir(path, 0777);
-            fp_ = fopen(filename, "a");
+            fd_ = OpenFile_(filename);
         }
-        assert(fp_ != nullptr);
+        assert(fd_ >= 0);
     }
 }
 
-/*这段代码实现了日志的写入功能，包括将日志按照日期和行数分割成不同的文件，以及将日志写入到文件或异步队列中。
-其中，使用了线程安全的缓冲区和锁机制来保证并发写入的正确性。
-函数接收一个可变参数，将格式化后的字符串写入缓冲区或异步队列中，并在特定条件下将缓冲区或异步队列中的日志写入到文件中*/
-/*buff_ 是一个缓冲区，用于存储日志信息，通过调用 Append 函数来将日志信息追加到缓冲区中，然后再将缓冲区的内容写入文件或放入异步队列中。
-缓冲区的作用在于减少写入文件的次数，提高写入效率。在 write 函数中，通过调用 buff_.RetrieveAll() 函数清空缓冲区，将缓冲区中的内容写入文件或放入异步队列中。*/
+/*这段代码实现了日志的写入功能。
+异步模式下，日志直接格式化进当前线程自己的暂存环，不加锁、不分配内存；环里连续的空间不够一条最长日志时，
+先格式化到线程自己的临时数组再分两段拷进环。环满时叫醒写线程并让出 CPU，直到写线程腾出空间。
+环里的数据超过一半时叫醒写线程把它取走；什么时候写进文件由刷新策略决定，PER_LINE 和达到 ON_LEVEL 等级的日志要求写线程立即写出。
+写线程按环成批取走，文件里只保证同一线程的日志有序，不同线程之间可能按时间戳略有交错。
+同步模式（或写线程已经退出）时格式化到栈上，加锁后直接 write 进文件。*/
 void Log::write(int level, const char* format, ...){
-    struct timeval now = {0, 0};
-    /*
-    原型
-    struct timeval
-    {
-    __time_t tv_sec;        //Seconds. 
-    __suseconds_t tv_usec;  //Microseconds. 
-    };
-    */
-    gettimeofday(&now, nullptr);               //int gettimeofday(struct  timeval*tv,struct  timezone *tz )
-    time_t tSec = now.tv_sec;
-    struct tm *sysTime = localtime(&tSec);
-    struct tm t = *sysTime;
     va_list vaList;
+    va_start(vaList, format);
+    if(!isAsync_ || isClosing_.load(memory_order_relaxed)){
+        char line[MAX_ENTRY];
+        int mday = 0;
+        size_t len = Format_(line, MAX_ENTRY, level, format, vaList, &mday);
+        va_end(vaList);
+        lock_guard<mutex> locker(mtx_);
+        if(fd_ < 0) return;
+        Rotate_(mday);
+        lineCount_++;
+        WriteAll_(line, len);
+        return;
+    }
 
-    //这段代码的意思是如果当前日期不等于记录的日期，或者日志行数达到了最大值，则需要进行日志文件的切换。
-    if(toDay_ != t.tm_mday || (lineCount_ && (lineCount_ % MAX_LINES == 0))){
-        unique_lock<mutex> locker(mtx_);
-        locker.unlock();
-        /*在这里解锁操作的目的是为了减小锁的粒度，避免对锁的占用时间过长。
-        如果不解锁，那么在修改日志文件名、清空计数器等操作时都需要持有锁，这样会对整个写日志的过程造成较大的阻塞，影响程序的性能。
-        因此，在这里先解锁，等到需要重新持有锁时再进行加锁操作，以达到减小锁粒度的目的。*/
-        char newFile[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
-
-        if(toDay_ != t.tm_mday){
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s%s%s", path_, tail, suffix_);
-            toDay_ = t.tm_mday;
-            lineCount_ = 0;
-        }else{
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s%s-%d%s", path_, tail, (lineCount_ / MAX_LINES), suffix_);
+    static thread_local char scratch[MAX_ENTRY];
+    LogRing* ring = LocalRing_();
+    char* dst = ring->Reserve(MAX_ENTRY);
+    int mday = 0;
+    size_t len = Format_(dst ? dst : scratch, MAX_ENTRY, level, format, vaList, &mday);
+    va_end(vaList);
+    if(dst){
+        ring->Commit(len);
+    }
+    else{
+        while(!ring->Append(scratch, len)){
+            if(isClosing_.load(memory_order_relaxed)){     //写线程已经退出，不会再腾出空间
+                lock_guard<mutex> locker(mtx_);
+                if(fd_ >= 0) WriteAll_(scratch, len);
+                return;
+            }
+            WakeWriter_();
+            this_thread::yield();
         }
+    }
+    int policy = flushPolicy_.load(memory_order_relaxed);
+    if(policy == PER_LINE || (policy == ON_LEVEL && level >= flushValue_.load(memory_order_relaxed))){
+        RequestFlush_();
+    }
+    else if(ring->ReadableBytes() >= ring->Capacity() / 2){
+        WakeWriter_();
+    }
+}
+
+/*一条日志的格式是 时间戳 + 等级 + 正文 + 换行。时间戳直接取 CoarseClock 事件循环每轮格式化好的字符串，
+不再每条日志调用 gettimeofday 和 localtime。正文超长时截断，保证结尾的换行。*/
+size_t Log::Format_(char* dst, size_t size, int level, const char* format, va_list vaList, int* mday){
+    static const char* TITLES[] = { "[debug]: ", "[info] : ", "[warn] : ", "[error]: " };
+    static const size_t TITLE_LEN = 9;
+    size_t len = CoarseClock::Instance()->LogTime(dst, mday);
+    memcpy(dst + len, (level >= 0 && level <= 3) ? TITLES[level] : TITLES[1], TITLE_LEN);
+    len += TITLE_LEN;
 
-        locker.lock();
-        flush();
-        fclose(fp_);
-        fp_ = fopen(newFile, "a");
-        assert(fp_ != nullptr);
+    size_t left = size - len - 1;   //给换行留一个字节
+    int m = vsnprintf(dst + len, left, format, vaList);
+    if(m > 0){
+        len += (static_cast<size_t>(m) < left) ? m : left - 1;
     }
-    /*这段代码的作用是将格式化的日志消息写入缓冲区中，然后将缓冲区的内容写入日志文件或添加到异步队列中。具体地：
+    dst[len++] = '\n';
+    return len;
+}
 
-    使用snprintf将时间信息和日志级别信息写入缓冲区。
-    使用vsnprintf将格式化后的日志消息写入缓冲区。
-    将换行符和字符串终止符添加到缓冲区中。
-    如果是异步模式且异步队列未满，则将缓冲区的内容添加到异步队列中。
-    如果不是异步模式或异步队列已满，则将缓冲区的内容写入日志文件中。
-    最后清空缓冲区中的数据。*/
-    {
-        unique_lock<mutex> locker(mtx_);
-        lineCount_++;
-        int n = snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ",     //返回写入字符数组的字符数
-            t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-            t.tm_hour, t.tm_min, t.tm_sec, now.tv_sec);
-
-        buff_.HasWritten(n);
-        AppendLevelTitle_(level);
-
-        /*这是可变参数函数的用法。在这个例子中，format 是一个格式化字符串，它接受不定数量的参数。
-        函数调用中的参数列表从 format 后面开始，因此我们需要使用 va_start() 宏来告诉程序从哪里开始读取这些参数，va_end() 宏告诉程序何时停止读取。
-        在这个函数中，vsnprintf() 函数接受可变参数列表，将其格式化为一个字符串，并将其写入日志缓冲区。*/
-        va_start(vaList, format);
-        int m = vsnprintf(buff_.BeginWrite(), buff_.WriteableBytes(), format, vaList);
-        va_end(vaList);
+/*切换到新的一天，或者当前文件的行数达到 MAX_LINES 时切换文件。写线程按批写入时由 Flush_ 在行数上限处把一批切开，每个文件不超过 MAX_LINES 行。*/
+void Log::Rotate_(int mday){
+    bool newDay = (toDay_ != mday);
+    if(!newDay && lineCount_ < (fileIndex_ + 1) * MAX_LINES) return;
 
-        buff_.HasWritten(m);
-        buff_.Append("\n\0", 2);
+    time_t tSec = time(nullptr);    //只有切换文件时才需要完整的日期
+    struct tm t;
+    localtime_r(&tSec, &t);
+    char newFile[LOG_NAME_LEN];
+    char tail[36] = {0};
+    snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
 
-        if(isAsync_ && deque_ && !deque_->full()){
-            deque_->push_back(buff_.RetrieveAllToStr());
-        }else{
-            fputs(buff_.Peek(), fp_);
-        }
-        buff_.RetrieveAll();
+    if(newDay){
+        snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
+        toDay_ = mday;
+        lineCount_ = 0;
+        fileIndex_ = 0;
+    }else{
+        fileIndex_ = lineCount_ / MAX_LINES;
+        snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, fileIndex_, suffix_);
+    }
+
+    close(fd_);
+    fd_ = OpenFile_(newFile);
+    assert(fd_ >= 0);
+}
+
+//和 fopen 的 "a" 一样：只写、不存在时创建、每次写都追加到末尾
+int Log::OpenFile_(const char* filename){
+    return open(filename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+}
+
+/*线程第一次写日志时创建自己的暂存环并登记到 rings_。环由 shared_ptr 共享：
+线程退出时 thread_local 对象析构，只把环标记为关闭，写线程取完剩下的日志后再把它从 rings_ 里移除。*/
+LogRing* Log::LocalRing_(){
+    struct Holder{
+        std::shared_ptr<LogRing> ring;
+        ~Holder(){ if(ring) ring->Close(); }
+    };
+    static thread_local Holder holder;
+    if(!holder.ring){
+        holder.ring.reset(new LogRing(RING_SIZE));     //按缓存行对齐分配，不用 make_shared
+        lock_guard<mutex> locker(ringsMtx_);
+        rings_.push_back(holder.ring);
     }
+    return holder.ring.get();
+}
+
+//先置位再加锁通知，写线程在锁内检查标志，不会漏掉唤醒；已经有人叫过时不再加锁
+void Log::WakeWriter_(){
+    if(wakePending_.load(memory_order_relaxed) || wakePending_.exchange(true)) return;
+    lock_guard<mutex> locker(wakeMtx_);
+    wakeCond_.notify_one();
 }
 
-void Log::AppendLevelTitle_(int level){
-    switch(level){
-        case(0):
-            buff_.Append("[debug]: ", 9);
-            break;
-        case(1):
-            buff_.Append("[info] : ", 9);
-            break;
-        case(2):
-            buff_.Append("[warn] : ", 9);
-            break;
-        case(3):
-            buff_.Append("[error]: ", 9);
-            break;
-        default:
-            buff_.Append("[info] : ", 9);
-            break;
+//先置位再叫醒：写线程醒来后先清掉 wakePending_ 再读 flushNow_，不会漏掉这次请求
+void Log::RequestFlush_(){
+    if(!flushNow_.load(memory_order_relaxed)){
+        flushNow_.store(true);
     }
+    WakeWriter_();
+}
+
+/*叫醒写线程并等它完成一轮完整的取数和写出：请求之前写进各个环的日志都已经写进当前文件。
+写线程还没启动或已经退出时没有可等的，直接返回。*/
+void Log::Drain_(){
+    if(!writeThread_ || isClosing_.load()) return;
+    unique_lock<mutex> locker(wakeMtx_);
+    uint64_t ticket = ++drainReq_;
+    wakePending_ = true;
+    wakeCond_.notify_one();
+    drainCond_.wait(locker, [this, ticket]{ return drainDone_ >= ticket || isClosing_.load(); });
 }
 
 void Log::flush(){
     if(isAsync_){
-        deque_->flush();
+        RequestFlush_();
     }
-    fflush(fp_);
 }
+
 /*这段代码实现了一个异步写日志的功能。Log类实现了一个静态函数Instance()，返回Log类的单例实例。
 在FlushLogThread()函数中，调用Instance()获取Log类的实例，并调用它的AsyncWrite_()函数进行异步写入。
-AsyncWrite_()函数中，从阻塞队列中取出待写入的日志字符串，并通过fputs函数将其写入文件中。由于异步写入的原因，日志的写入与主线程的执行是异步的，不会影响主线程的性能表现。*/
+写线程是唯一写文件的线程：被叫醒（某个环超过一半、有人要求立即写出）或等到策略规定的时间后，先把所有环里的数据拷进自己的大缓冲，
+腾出环的空间，再按刷新策略决定这一轮是否把缓冲 write 出去；退出前把剩下的都写完。*/
 void Log::AsyncWrite_(){
-    string str = "";
-    while(deque_->pop(str)){
-        lock_guard<mutex> locker(mtx_);
-        fputs(str.c_str(), fp_);
+    auto lastFlush = chrono::steady_clock::now();
+    uint64_t drainReq = 0;
+    while(true){
+        int policy = flushPolicy_.load(memory_order_relaxed);
+        int value = flushValue_.load(memory_order_relaxed);
+        int intervalMs = FLUSH_INTERVAL_MS;
+        if(policy == INTERVAL) intervalMs = value;
+        else if(policy == SIZE) intervalMs = SIZE_MAX_AGE_MS;
+        auto deadline = lastFlush + chrono::milliseconds(intervalMs);
+        {
+            unique_lock<mutex> locker(wakeMtx_);
+            wakeCond_.wait_until(locker, deadline, [this]{
+                return wakePending_.load() || isClosing_.load();
+            });
+            drainReq = drainReq_;      //这之前登记的 Drain_ 请求由这一轮完成
+        }
+        wakePending_ = false;
+        bool closing = isClosing_;
+        bool urgent = flushNow_.exchange(false);
+        Collect_();
+
+        auto now = chrono::steady_clock::now();
+        bool due = now >= deadline;
+        bool full = (policy == SIZE && outLen_ >= static_cast<size_t>(value));
+        bool drain = drainReq > drainDone_;
+        if(urgent || closing || due || full || drain){
+            Flush_();
+            lastFlush = now;
+        }
+        if(drain){
+            lock_guard<mutex> locker(wakeMtx_);
+            drainDone_ = drainReq;
+            drainCond_.notify_all();
+        }
+        if(closing) break;
+    }
+}
+
+/*先看环是否已经关闭，再取可读的数据：关闭之前写入的都已经发布，取完之后环一定是空的，可以安全移除。
+每个环的数据（绕回时是两段）拷进输出缓冲后马上归还空间，生产者不用等文件写完；缓冲放不下时先写出一次。顺便数一下换行得到行数。*/
+void Log::Collect_(){
+    vector<shared_ptr<LogRing>> rings;
+    {
+        lock_guard<mutex> locker(ringsMtx_);
+        rings = rings_;
+    }
+    bool anyClosed = false;
+    vector<bool> closed(rings.size(), false);
+    for(size_t i = 0; i < rings.size(); i++){
+        closed[i] = rings[i]->IsClosed();
+        anyClosed = anyClosed || closed[i];
+        struct iovec iov[2];
+        int n = 0;
+        size_t len = rings[i]->Peek(iov, &n);
+        if(len == 0) continue;
+        if(outLen_ + len > OUT_BUFFER_SIZE){
+            Flush_();
+        }
+        for(int j = 0; j < n; j++){
+            const char* p = static_cast<const char*>(iov[j].iov_base);
+            const char* end = p + iov[j].iov_len;
+            memcpy(out_.get() + outLen_, p, iov[j].iov_len);
+            outLen_ += iov[j].iov_len;
+            while((p = static_cast<const char*>(memchr(p, '\n', end - p))) != nullptr){
+                outLines_++;
+                p++;
+            }
+        }
+        rings[i]->Retrieve(len);
+    }
+
+    if(anyClosed){
+        lock_guard<mutex> locker(ringsMtx_);
+        for(size_t i = 0; i < rings.size(); i++){
+            if(!closed[i]) continue;
+            for(auto it = rings_.begin(); it != rings_.end(); ++it){
+                if(*it == rings[i]){
+                    rings_.erase(it);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/*把缓冲写出，行数记到当前文件上。当前文件剩下的行数放不下整批时，在第 budget 个换行之后切开，
+前一段写进当前文件，切换文件后继续写剩下的部分。*/
+void Log::Flush_(){
+    if(outLen_ == 0) return;
+    int mday = 0;
+    char timeStr[CoarseClock::LOG_TIME_LEN];
+    CoarseClock::Instance()->LogTime(timeStr, &mday);
+    lock_guard<mutex> locker(mtx_);
+    const char* p = out_.get();
+    const char* end = p + outLen_;
+    int lines = outLines_;
+    while(fd_ >= 0 && p < end){
+        Rotate_(mday);
+        int budget = (fileIndex_ + 1) * MAX_LINES - lineCount_;
+        const char* cut = end;
+        int n = lines;
+        if(lines > budget){
+            cut = p;
+            for(int i = 0; i < budget; i++){
+                cut = static_cast<const char*>(memchr(cut, '\n', end - cut)) + 1;
+            }
+            n = budget;
+        }
+        lineCount_ += n;
+        WriteAll_(p, cut - p);
+        p = cut;
+        lines -= n;
+    }
+    outLen_ = 0;
+    outLines_ = 0;
+}
+
+//write 可能只写出一部分，按实际写出的字节数前移直到写完；出错时丢掉剩下的部分
+void Log::WriteAll_(const char* data, size_t len){
+    while(len > 0){
+        ssize_t n = ::write(fd_, data, len);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        len -= n;
     }
 }
 
@@ -237,6 +431,5 @@ Log* Log::Instance(){
 }
 
 void Log::FlushLogThread(){
-    Log::Instance()->AsyncWrite_(); 
+    Log::Instance()->AsyncWrite_();
 }
-
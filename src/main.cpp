@@ -6,10 +6,28 @@ int main() {
     /* 守护进程 后台运行 */
     //daemon(1, 0); 
     
+    ServerOptions options;
+    options.compress.precompress = true;        /* 启动时生成 .gz 预压缩副本 */
+    options.compress.level = 6;                 /* 运行时压缩等级 */
+    options.readBuffer.keepBytes = 8 * 1024;    /* 读缓冲读空后留下的块超过这个大小、又空闲 idleMs 毫秒时归还，负数不收缩 */
+    options.readBuffer.idleMs = 10 * 1000;
+    options.resource.preload = true;            /* 预加载资源 */
+    options.resource.zeroCopyThreshold = 0;     /* 零拷贝发送阈值（字节），0 关闭 */
+    options.pool.queueLimit = 4096;             /* 线程池排队上限（0 不限制） */
+    options.pool.overloadPolicy = ThreadPool::SHED;
+    options.pool.maxThreadNum = 12;             /* 线程池自动调整的最大线程数，不大于线程池数量时不调整 */
+    options.pool.blockingThreadNum = 4;         /* 访问数据库的请求单独使用的线程数，0 不单独分开 */
+    options.cpus.loop = "";                     /* 事件循环 工作线程 日志线程绑定的 CPU，如 "0-3,8" 或 "node:0"，空串不绑定 */
+    options.cpus.worker = "";
+    options.cpus.log = "";
+    options.logFlush.policy = Log::ON_LEVEL;    /* 日志刷新策略及参数：ERROR 及以上立即写出，其余每 100ms 写一次 */
+    options.logFlush.value = 3;
+
     WebServer server(
         34509, 3, 60000, false,             /* 端口 ET模式 timeoutMs 优雅退出  */
         3306, "root", "zxcvbnm123", "myserveruser", /* Mysql配置 */
-        12, 6, true, 1, 1024);             /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        12, 6, true, 1, 1024,              /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        options);
     server.Start();
 } 
   
\ No newline at end of file
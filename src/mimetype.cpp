@@ -0,0 +1,118 @@
+#include "mimetype.h"
+
+using namespace std;
+
+struct MimeEntry{
+    const char* ext;    //不带点的小写后缀
+    const char* type;
+};
+
+//resources 下用到的字体、图标、视频等类型都要在这里
+static constexpr MimeEntry MIME_TYPES[] = {
+    { "html",   "text/html" },
+    { "htm",    "text/html" },
+    { "xml",    "text/xml" },
+    { "xhtml",  "application/xhtml+xml" },
+    { "txt",    "text/plain" },
+    { "css",    "text/css" },
+    { "js",     "text/javascript" },
+    { "mjs",    "text/javascript" },
+    { "json",   "application/json" },
+    { "wasm",   "application/wasm" },
+    { "rtf",    "application/rtf" },
+    { "pdf",    "application/pdf" },
+    { "doc",    "application/msword" },
+    { "word",   "application/msword" },
+    { "gz",     "application/x-gzip" },
+    { "tar",    "application/x-tar" },
+    { "png",    "image/png" },
+    { "gif",    "image/gif" },
+    { "jpg",    "image/jpeg" },
+    { "jpeg",   "image/jpeg" },
+    { "webp",   "image/webp" },
+    { "svg",    "image/svg+xml" },
+    { "ico",    "image/x-icon" },
+    { "woff",   "font/woff" },
+    { "woff2",  "font/woff2" },
+    { "ttf",    "font/ttf" },
+    { "otf",    "font/otf" },
+    { "eot",    "application/vnd.ms-fontobject" },
+    { "au",     "audio/basic" },
+    { "mp3",    "audio/mpeg" },
+    { "mpeg",   "video/mpeg" },
+    { "mpg",    "video/mpeg" },
+    { "mp4",    "video/mp4" },
+    { "webm",   "video/webm" },
+    { "avi",    "video/x-msvideo" },
+};
+
+static constexpr size_t MIME_COUNT = sizeof(MIME_TYPES) / sizeof(MIME_TYPES[0]);
+static constexpr size_t SLOT_COUNT = 128;   //2 的幂，装载率保持在一半以下
+static constexpr size_t MAX_EXT_LEN = 8;
+static const char* const DEFAULT_TYPE = "text/plain";
+
+static_assert(MIME_COUNT * 2 <= SLOT_COUNT, "MIME table too full");
+static_assert(MIME_COUNT < 255, "slot index overflow");
+
+static constexpr size_t Length(const char* s){
+    size_t len = 0;
+    while(s[len]) len++;
+    return len;
+}
+
+//FNV-1a
+static constexpr uint32_t Hash(const char* s, size_t len){
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < len; i++){
+        h = (h ^ static_cast<unsigned char>(s[i])) * 16777619u;
+    }
+    return h;
+}
+
+//槽里放表项下标加一，0 表示空槽；线性探测
+struct MimeSlots{
+    unsigned char index[SLOT_COUNT];
+};
+
+static constexpr MimeSlots BuildSlots(){
+    MimeSlots slots{};
+    for(size_t i = 0; i < MIME_COUNT; i++){
+        size_t pos = Hash(MIME_TYPES[i].ext, Length(MIME_TYPES[i].ext)) & (SLOT_COUNT - 1);
+        while(slots.index[pos]) pos = (pos + 1) & (SLOT_COUNT - 1);
+        slots.index[pos] = static_cast<unsigned char>(i + 1);
+    }
+    return slots;
+}
+
+static constexpr MimeSlots MIME_SLOTS = BuildSlots();
+
+const char* MimeType::Of(const char* path, size_t len){
+    const char* type = Find(path, len);
+    return type ? type : DEFAULT_TYPE;
+}
+
+const char* MimeType::Find(const char* path, size_t len){
+    //从末尾往前找后缀，遇到 '/' 说明最后一段没有后缀
+    char ext[MAX_EXT_LEN];
+    size_t extLen = 0;
+    size_t i = len;
+    while(i > 0 && path[i - 1] != '.'){
+        char c = path[--i];
+        if(c == '/' || ++extLen > MAX_EXT_LEN) return nullptr;
+    }
+    if(i == 0 || extLen == 0) return nullptr;
+    for(size_t j = 0; j < extLen; j++){
+        char c = path[i + j];
+        ext[j] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+
+    size_t pos = Hash(ext, extLen) & (SLOT_COUNT - 1);
+    while(MIME_SLOTS.index[pos]){
+        const MimeEntry& entry = MIME_TYPES[MIME_SLOTS.index[pos] - 1];
+        if(Length(entry.ext) == extLen && memcmp(entry.ext, ext, extLen) == 0){
+            return entry.type;
+        }
+        pos = (pos + 1) & (SLOT_COUNT - 1);
+    }
+    return nullptr;
+}
@@ -0,0 +1,255 @@
+#include "outputqueue.h"
+
+using namespace std;
+
+const size_t OutputQueue::OWNED_BLOCK_SIZE;
+const long long OutputQueue::PIN_GRACE_MS;
+atomic<size_t> OutputQueue::zeroCopyThreshold_(0);
+atomic<unsigned long long> OutputQueue::zcSends_(0);
+atomic<unsigned long long> OutputQueue::zcBytes_(0);
+atomic<unsigned long long> OutputQueue::zcCompleted_(0);
+atomic<unsigned long long> OutputQueue::zcCopied_(0);
+mutex OutputQueue::orphanMtx_;
+deque<pair<long long, OutputQueue::Holder>> OutputQueue::orphans_;
+
+OutputQueue::OutputQueue(): bytes_(0), zeroCopy_(false), zcNextId_(0){}
+
+OutputQueue::~OutputQueue(){
+    Clear();
+}
+
+char* OutputQueue::Reserve(size_t len){
+    if(!segments_.empty()){
+        Segment& tail = segments_.back();
+        if(tail.type == OWNED && tail.block + tail.cap - (tail.data + tail.len) >= static_cast<ptrdiff_t>(len)){
+            return const_cast<char*>(tail.data + tail.len);
+        }
+    }
+    Segment seg;
+    seg.type = OWNED;
+    seg.cap = max(len, OWNED_BLOCK_SIZE);
+    seg.block = BufferPool::Alloc(&seg.cap);
+    seg.data = seg.block;
+    seg.len = 0;
+    seg.fd = -1;
+    seg.offset = 0;
+    segments_.push_back(move(seg));
+    return segments_.back().block;
+}
+
+void OutputQueue::Commit(size_t len){
+    assert(!segments_.empty() && segments_.back().type == OWNED);
+    Segment& tail = segments_.back();
+    assert(tail.data + tail.len + len <= tail.block + tail.cap);
+    tail.len += len;
+    bytes_ += len;
+}
+
+void OutputQueue::Append(const char* data, size_t len){
+    if(len == 0) return;
+    assert(data);
+    memcpy(Reserve(len), data, len);
+    Commit(len);
+}
+
+void OutputQueue::AppendRef(const char* data, size_t len, Holder holder){
+    if(len == 0) return;
+    assert(data);
+    Segment seg;
+    seg.type = REF;
+    seg.data = data;
+    seg.len = len;
+    seg.block = nullptr;
+    seg.cap = 0;
+    seg.holder = move(holder);
+    seg.fd = -1;
+    seg.offset = 0;
+    segments_.push_back(move(seg));
+    bytes_ += len;
+}
+
+void OutputQueue::AppendFile(int fd, off_t offset, size_t len){
+    assert(fd >= 0);
+    if(len == 0){
+        close(fd);
+        return;
+    }
+    Segment seg;
+    seg.type = FILE;
+    seg.data = nullptr;
+    seg.len = len;
+    seg.block = nullptr;
+    seg.cap = 0;
+    seg.fd = fd;
+    seg.offset = offset;
+    segments_.push_back(move(seg));
+    bytes_ += len;
+}
+
+void OutputQueue::Release_(Segment& seg){
+    if(seg.type == OWNED){
+        BufferPool::Free(seg.block, seg.cap);
+        seg.block = nullptr;
+    }
+    else if(seg.type == FILE && seg.fd >= 0){
+        close(seg.fd);
+        seg.fd = -1;
+    }
+    seg.holder.reset();
+}
+
+/*还没完成的零拷贝引用不能马上释放：close 之后内核可能还在发送这段内存，先放进 orphans_ 保留一段时间。
+序号随套接字重新开始。*/
+void OutputQueue::Clear(){
+    for(Segment& seg : segments_){
+        Release_(seg);
+    }
+    segments_.clear();
+    bytes_ = 0;
+
+    long long now = CoarseClock::Instance()->NowMs();
+    if(!pins_.empty()){
+        lock_guard<mutex> locker(orphanMtx_);
+        for(Pin& pin : pins_){
+            orphans_.emplace_back(now, move(pin.holder));
+        }
+        while(!orphans_.empty() && now - orphans_.front().first >= PIN_GRACE_MS){
+            orphans_.pop_front();
+        }
+    }
+    pins_.clear();
+    zcNextId_ = 0;
+    zeroCopy_ = false;
+}
+
+void OutputQueue::Consume_(size_t len){
+    assert(len <= bytes_);
+    bytes_ -= len;
+    while(len > 0){
+        Segment& seg = segments_.front();
+        if(len < seg.len){
+            if(seg.type == FILE) seg.offset += len;
+            else seg.data += len;
+            seg.len -= len;
+            return;
+        }
+        len -= seg.len;
+        Release_(seg);
+        segments_.pop_front();
+    }
+}
+
+/*队首的大 REF 片段单独用 MSG_ZEROCOPY 发送。成功后内核的计数加一，这段内存的 holder 记在 pins_ 里，
+等完成通知再释放；只发出一部分时片段留在队首，下次从剩下的位置继续，同样记一次。
+内核的选项内存不够（ENOBUFS）时这一次退回普通发送。*/
+ssize_t OutputQueue::SendZeroCopy_(int fd, int* saveErrno){
+    const Segment& front = segments_.front();
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(front.data);
+    iov.iov_len = front.len;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    int flags = MSG_NOSIGNAL | (segments_.size() > 1 ? MSG_MORE : 0);
+    ssize_t len = sendmsg(fd, &msg, flags | MSG_ZEROCOPY);
+    if(len < 0 && errno == ENOBUFS){
+        len = sendmsg(fd, &msg, flags);
+    }
+    else if(len >= 0){
+        pins_.push_back({ zcNextId_++, front.holder });
+        zcSends_++;
+        zcBytes_ += len;
+    }
+    if(len < 0){
+        *saveErrno = errno;
+        return len;
+    }
+    Consume_(len);
+    return len;
+}
+
+/*一次通知给出一段已完成的序号 [lo, hi]，序号是 32 位的，可能回绕，按差值比较。*/
+int OutputQueue::ReapZeroCopy(int fd){
+    int count = 0;
+    while(true){
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if(recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+        for(struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)){
+            if(!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))){
+                continue;
+            }
+            const struct sock_extended_err* serr = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+            if(serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            uint32_t lo = serr->ee_info, hi = serr->ee_data;
+            unsigned long long done = static_cast<uint32_t>(hi - lo) + 1ULL;
+            zcCompleted_ += done;
+            if(serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) zcCopied_ += done;
+            while(!pins_.empty() && static_cast<uint32_t>(pins_.front().id - lo) <= static_cast<uint32_t>(hi - lo)){
+                pins_.pop_front();
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+OutputQueue::ZeroCopyStats OutputQueue::GetZeroCopyStats(){
+    return { zcSends_.load(), zcBytes_.load(), zcCompleted_.load(), zcCopied_.load() };
+}
+
+/*队首是文件就 sendfile 这一段；否则把到下一个文件片段为止的内存片段收集进 iovec 一次发出，
+后面还有文件时带上 MSG_MORE，让响应头和文件内容尽量合在同一个报文里。
+打开零拷贝时，大的 REF 片段单独发送，普通批次在它前面截止。*/
+ssize_t OutputQueue::WriteFd(int fd, int* saveErrno){
+    if(segments_.empty()) return 0;
+    ssize_t len;
+    const Segment& front = segments_.front();
+    size_t threshold = zeroCopyThreshold_.load(memory_order_relaxed);
+    bool zeroCopy = zeroCopy_ && threshold > 0;
+    if(zeroCopy && front.type == REF && front.len >= threshold){
+        return SendZeroCopy_(fd, saveErrno);
+    }
+    if(front.type == FILE){
+        off_t offset = front.offset;
+        len = sendfile(fd, front.fd, &offset, front.len);
+        if(len == 0){   //文件在发送过程中被截断，剩下的内容永远发不出去
+            *saveErrno = EIO;
+            return -1;
+        }
+    }
+    else{
+        static thread_local struct iovec iov[IOV_MAX];
+        int cnt = 0;
+        bool more = false;
+        for(const Segment& seg : segments_){
+            if(seg.type == FILE || (zeroCopy && seg.type == REF && seg.len >= threshold)){
+                more = true;
+                break;
+            }
+            if(cnt == IOV_MAX){
+                more = true;
+                break;
+            }
+            iov[cnt].iov_base = const_cast<char*>(seg.data);
+            iov[cnt].iov_len = seg.len;
+            cnt++;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = cnt;
+        len = sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+    }
+    if(len < 0){
+        *saveErrno = errno;
+        return len;
+    }
+    Consume_(len);
+    return len;
+}
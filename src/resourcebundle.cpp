@@ -0,0 +1,119 @@
+#include "resourcebundle.h"
+
+using namespace std;
+
+ResourceBundle::ResourceBundle(){
+    arena_ = nullptr;
+    arenaSize_ = used_ = 0;
+    hugePage_ = false;
+}
+
+ResourceBundle::~ResourceBundle(){
+    if(arena_){
+        munmap(arena_, arenaSize_);
+    }
+}
+
+ResourceBundle* ResourceBundle::Instance(){
+    static ResourceBundle bundle;
+    return &bundle;
+}
+
+void ResourceBundle::Collect_(const string& srcDir, const string& relDir, size_t maxFileSize, vector<File>& files){
+    DIR* dp = opendir((srcDir + relDir).data());
+    if(!dp) return;
+    struct dirent* entry;
+    while((entry = readdir(dp)) != nullptr){
+        if(entry->d_name[0] == '.') continue;   //跳过 . .. 以及 .DS_Store 之类的隐藏文件
+        File file;
+        file.path = relDir + "/" + entry->d_name;
+        if(stat((srcDir + file.path).data(), &file.st) < 0) continue;
+        if(S_ISDIR(file.st.st_mode)){
+            Collect_(srcDir, file.path, maxFileSize, files);
+        }
+        else if(S_ISREG(file.st.st_mode) && (file.st.st_mode & S_IROTH)
+                && file.st.st_size > 0 && static_cast<size_t>(file.st.st_size) <= maxFileSize){
+            files.push_back(file);
+        }
+    }
+    closedir(dp);
+}
+
+//先尝试显式的大页，没有预留大页时退回普通页并建议内核使用透明大页
+char* ResourceBundle::AllocArena_(size_t size){
+    arenaSize_ = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void* ptr = mmap(nullptr, arenaSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(ptr != MAP_FAILED){
+        hugePage_ = true;
+        return (char*)ptr;
+    }
+    ptr = mmap(nullptr, arenaSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ptr == MAP_FAILED) return nullptr;
+    madvise(ptr, arenaSize_, MADV_HUGEPAGE);
+    return (char*)ptr;
+}
+
+bool ResourceBundle::Load(const string& srcDir, size_t maxFileSize, size_t maxTotalSize){
+    assert(arena_ == nullptr);
+    string dir = srcDir;
+    while(!dir.empty() && dir.back() == '/') dir.pop_back();
+
+    vector<File> files;
+    Collect_(dir, "", maxFileSize, files);
+
+    //每个文件按 64 字节对齐，超过总量上限的文件不再加载
+    size_t total = 0;
+    size_t count = 0;
+    for(; count < files.size(); count++){
+        size_t len = (files[count].st.st_size + 63) & ~size_t(63);
+        if(total + len > maxTotalSize) break;
+        total += len;
+    }
+    if(total == 0) return false;
+
+    arena_ = AllocArena_(total);
+    if(!arena_){
+        LOG_ERROR("Preload: alloc %d bytes error!", (int)total);
+        return false;
+    }
+
+    index_.reserve(count);
+    for(size_t i = 0; i < count; i++){
+        const File& file = files[i];
+        int fd = open((dir + file.path).data(), O_RDONLY);
+        if(fd < 0) continue;
+        char* dst = arena_ + used_;
+        size_t len = file.st.st_size;
+        size_t done = 0;
+        while(done < len){
+            ssize_t n = read(fd, dst + done, len - done);
+            if(n <= 0) break;
+            done += n;
+        }
+        close(fd);
+        if(done != len) continue;   //读取期间文件被截断，放弃这个文件
+        index_[file.path] = { dst, len, file.st };
+        used_ += (len + 63) & ~size_t(63);
+    }
+
+    //加载完成后只读，后续只有查找
+    mprotect(arena_, arenaSize_, PROT_READ);
+    LOG_INFO("Preload: %d files, %d bytes, hugepage: %s", (int)index_.size(), (int)used_, hugePage_ ? "true" : "false");
+    return true;
+}
+
+const ResourceBundle::Item* ResourceBundle::Find(const string& path) const{
+    auto it = index_.find(path);
+    if(it == index_.end()) return nullptr;
+    return &it->second;
+}
+
+const char* ResourceBundle::FindFresh(const string& path, const struct stat& st) const{
+    const Item* item = Find(path);
+    if(!item) return nullptr;
+    if(item->st.st_ino != st.st_ino || item->st.st_size != st.st_size
+        || item->st.st_mtim.tv_sec != st.st_mtim.tv_sec || item->st.st_mtim.tv_nsec != st.st_mtim.tv_nsec){
+        return nullptr;
+    }
+    return item->data;
+}
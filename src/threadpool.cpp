@@ -0,0 +1,359 @@
+#include "threadpool.h"
+
+using namespace std;
+
+const size_t ThreadPool::INJECT_BATCH;
+
+//当前线程所属的线程池和编号，非工作线程为 nullptr
+static thread_local const void* tlsPool = nullptr;
+static thread_local size_t tlsIndex = 0;
+
+/*按上限一次建好所有工作线程的槽位，窃取时遍历的数组之后不再变化；只启动前 threadCount 个线程*/
+ThreadPool::ThreadPool(size_t threadCount, size_t maxThreadCount): pool_(new Pool()) {
+    assert(threadCount > 0);
+    maxThreadCount = max(threadCount, maxThreadCount);
+    for(size_t i = 0; i < maxThreadCount; i++) {
+        pool_->workers.emplace_back(new Worker());
+        pool_->workers.back()->seed = static_cast<unsigned>(i * 2654435761u + 1);
+    }
+    lock_guard<mutex> locker(pool_->mtx);
+    pool_->target.store(threadCount, memory_order_relaxed);
+    for(size_t i = 0; i < threadCount; i++) {
+        Start_(pool_, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    Shutdown();
+}
+
+//调用时持有 pool->mtx
+void ThreadPool::Start_(const shared_ptr<Pool>& pool, size_t index) {
+    Worker& worker = *pool->workers[index];
+    worker.running = true;
+    worker.thread = thread(WorkerLoop_, pool, index);
+    Pin_(*pool, index);
+}
+
+//调用时持有 pool.mtx；每个线程只绑一个核，线程池自己的内存池块都在这个核所在的节点上
+void ThreadPool::Pin_(Pool& pool, size_t index) {
+    if(pool.cpus.empty()) return;
+    Affinity::Pin(pool.workers[index]->thread.native_handle(), { pool.cpus[index % pool.cpus.size()] });
+}
+
+void ThreadPool::SetAffinity(const vector<int>& cpus) {
+    assert(pool_);
+    lock_guard<mutex> locker(pool_->mtx);
+    pool_->cpus = cpus;
+    for(size_t i = 0; i < pool_->workers.size(); i++) {
+        if(pool_->workers[i]->running) Pin_(*pool_, i);
+    }
+}
+
+size_t ThreadPool::Shutdown(int drainMs) {
+    if(!pool_) return 0;
+    Pool& pool = *pool_;
+    {
+        lock_guard<mutex> locker(pool.mtx);
+        if(!pool.isClosed.load(memory_order_relaxed)) {
+            pool.deadlineUs = drainMs < 0 ? -1 : NowUs_() + drainMs * 1000LL;
+            pool.isClosed.store(true, memory_order_release);
+        }
+    }
+    pool.cond.notify_all();
+    for(auto& worker : pool.workers) {
+        if(worker->thread.joinable() && worker->thread.get_id() != this_thread::get_id()) {
+            worker->thread.join();
+        }
+    }
+
+    //过了期限没来得及执行的任务
+    size_t dropped = 0;
+    Item item;
+    for(auto& worker : pool.workers) {
+        while(worker->tasks.Pop(item)) dropped++;
+    }
+    {
+        while(pool.injected.try_pop(item)) dropped++;
+        lock_guard<mutex> locker(pool.overflowMtx);
+        dropped += pool.overflow.size();
+        pool.overflow.clear();
+        pool.overflowSize.store(0, memory_order_relaxed);
+    }
+    pool.pending.fetch_sub(dropped, memory_order_relaxed);
+    return pool.dropped.fetch_add(dropped, memory_order_relaxed) + dropped;
+}
+
+/*增加时启动槽位上没有在运行的线程；槽位上的线程如果正在退出，先 join 再重新启动。
+减少时只修改 target 并唤醒所有线程，多出来的线程做完本地队列后自己退出，线程对象留到下次启动或 Shutdown 时 join。*/
+void ThreadPool::Resize(size_t threadCount) {
+    assert(pool_);
+    Pool& pool = *pool_;
+    threadCount = max<size_t>(1, min(threadCount, pool.workers.size()));
+    {
+        lock_guard<mutex> locker(pool.mtx);
+        if(pool.isClosed.load(memory_order_relaxed)) return;
+        pool.target.store(threadCount, memory_order_relaxed);
+        for(size_t i = 0; i < threadCount; i++) {
+            Worker& worker = *pool.workers[i];
+            if(worker.running) continue;
+            if(worker.thread.joinable()) worker.thread.join();
+            Start_(pool_, i);
+        }
+    }
+    pool.cond.notify_all();
+}
+
+vector<ThreadPool::WorkerStats> ThreadPool::GetWorkerStats() const {
+    vector<WorkerStats> result;
+    if(!pool_) return result;
+    lock_guard<mutex> locker(pool_->mtx);
+    for(auto& worker : pool_->workers) {
+        WorkerStats stats;
+        stats.running = worker->running;
+        stats.tasks = worker->taskCount.load(memory_order_relaxed);
+        stats.steals = worker->steals.load(memory_order_relaxed);
+        stats.busyUs = worker->busyUs.load(memory_order_relaxed);
+        stats.idleUs = worker->idleUs.load(memory_order_relaxed);
+        result.push_back(stats);
+    }
+    return result;
+}
+
+void ThreadPool::SetQueueLimit(size_t maxPending, OVERLOAD policy) {
+    assert(pool_);
+    pool_->maxPending = maxPending;
+    pool_->policy = policy;
+}
+
+ThreadPool::QueueStats ThreadPool::GetQueueStats() const {
+    assert(pool_);
+    const Pool& pool = *pool_;
+    QueueStats stats;
+    stats.depth = pool.pending.load(memory_order_relaxed);
+    stats.peakDepth = pool.peakDepth.load(memory_order_relaxed);
+    stats.submitted = pool.submitted.load(memory_order_relaxed);
+    stats.rejected = pool.rejected.load(memory_order_relaxed);
+    stats.blocked = pool.blocked.load(memory_order_relaxed);
+    stats.executed = pool.executed.load(memory_order_relaxed);
+    stats.waitUsTotal = pool.waitUsTotal.load(memory_order_relaxed);
+    stats.waitUsMax = pool.waitUsMax.load(memory_order_relaxed);
+    stats.runUsTotal = pool.runUsTotal.load(memory_order_relaxed);
+    stats.runUsMax = pool.runUsMax.load(memory_order_relaxed);
+    return stats;
+}
+
+/*占一个排队名额，队列满时按策略等待或返回 false。
+用 CAS 占位，多个提交者同时提交也不会超过上限。BLOCK 时提交者先登记再重新检查，
+工作线程取走任务后看到有人登记就在同一把锁下唤醒，和睡眠唤醒一样不会漏掉。*/
+bool ThreadPool::Admit_(Pool& pool, bool mayWait) {
+    size_t cur = pool.pending.load(memory_order_relaxed);
+    while(cur < pool.maxPending) {
+        if(pool.pending.compare_exchange_weak(cur, cur + 1, memory_order_relaxed)) return true;
+    }
+    if(pool.policy != BLOCK || !mayWait) {
+        pool.rejected.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    pool.blocked.fetch_add(1, memory_order_relaxed);
+    unique_lock<mutex> locker(pool.fullMtx);
+    pool.blockedWaiters.fetch_add(1, memory_order_seq_cst);
+    while(true) {
+        cur = pool.pending.load(memory_order_seq_cst);
+        if(cur < pool.maxPending && pool.pending.compare_exchange_weak(cur, cur + 1, memory_order_relaxed)) break;
+        if(cur >= pool.maxPending) pool.notFull.wait(locker);
+    }
+    pool.blockedWaiters.fetch_sub(1, memory_order_relaxed);
+    return true;
+}
+
+/*工作线程提交的任务放进自己的本地队列，其余放进注入队列。
+放进去之后如果有线程在睡眠，加锁唤醒一个；睡眠的线程在同一把锁下先登记再检查有没有活，两边都有全序的栅栏，不会漏掉唤醒。*/
+bool ThreadPool::Submit_(Task&& task, bool bounded, bool mayWait) {
+    assert(pool_);
+    Pool& pool = *pool_;
+    bool isWorker = (tlsPool == &pool);
+    if(pool.isClosed.load(memory_order_acquire) && !isWorker) {   //排空期间只接受已有任务派生的任务
+        pool.rejected.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    if(bounded && pool.maxPending > 0 && !isWorker) {
+        if(!Admit_(pool, mayWait)) return false;
+    }
+    else {
+        pool.pending.fetch_add(1, memory_order_relaxed);
+    }
+    size_t depth = pool.pending.load(memory_order_relaxed);
+    size_t peak = pool.peakDepth.load(memory_order_relaxed);
+    while(depth > peak && !pool.peakDepth.compare_exchange_weak(peak, depth, memory_order_relaxed)) {}
+    pool.submitted.fetch_add(1, memory_order_relaxed);
+
+    Item item{ std::move(task), NowUs_() };
+    if(isWorker && pool.workers[tlsIndex]->tasks.Push(std::move(item))) {
+        //放进了本地队列
+    }
+    else if(!pool.injected.try_push(std::move(item))) {
+        PushOverflow_(pool, std::move(item));
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if(pool.sleeping.load(memory_order_relaxed) > 0) {
+        lock_guard<mutex> locker(pool.mtx);
+        pool.cond.notify_one();
+    }
+    return true;
+}
+
+//任务开始执行前调用：让出排队名额，记录等待时间
+void ThreadPool::OnDequeue_(Pool& pool, const Item& item, long long nowUs) {
+    pool.pending.fetch_sub(1, memory_order_seq_cst);
+    if(pool.blockedWaiters.load(memory_order_seq_cst) > 0) {
+        lock_guard<mutex> locker(pool.fullMtx);
+        pool.notFull.notify_one();
+    }
+    long long wait = nowUs - item.enqueueUs;
+    unsigned long long waitUs = wait > 0 ? static_cast<unsigned long long>(wait) : 0;
+    pool.executed.fetch_add(1, memory_order_relaxed);
+    pool.waitUsTotal.fetch_add(waitUs, memory_order_relaxed);
+    unsigned long long maxUs = pool.waitUsMax.load(memory_order_relaxed);
+    while(waitUs > maxUs && !pool.waitUsMax.compare_exchange_weak(maxUs, waitUs, memory_order_relaxed)) {}
+}
+
+void ThreadPool::PushOverflow_(Pool& pool, Item&& item) {
+    lock_guard<mutex> locker(pool.overflowMtx);
+    pool.overflow.emplace_back(std::move(item));
+    pool.overflowSize.fetch_add(1, memory_order_relaxed);
+}
+
+//和注入队列一样一次多取几个，溢出时提交得很快，不能每个任务都加一次锁
+bool ThreadPool::TakeOverflow_(Pool& pool, size_t index, Item& item) {
+    if(pool.overflowSize.load(memory_order_relaxed) == 0) return false;
+    lock_guard<mutex> locker(pool.overflowMtx);
+    if(pool.overflow.empty()) return false;
+    item = std::move(pool.overflow.front());
+    pool.overflow.pop_front();
+    size_t batch = min(INJECT_BATCH, pool.overflow.size() / pool.workers.size());
+    size_t taken = 1;
+    Worker& self = *pool.workers[index];
+    for(size_t i = 0; i < batch; i++) {
+        if(!self.tasks.Push(std::move(pool.overflow.front()))) break;
+        pool.overflow.pop_front();
+        taken++;
+    }
+    pool.overflowSize.fetch_sub(taken, memory_order_relaxed);
+    return true;
+}
+
+/*从注入队列取一个来执行，再多取一些放进本地队列，让空闲的线程可以来窃取。
+整批用 try_pop_n 取走，不加锁，也只唤醒一次等空位的提交者；多取的任务本地队列放不下时放回溢出队列。*/
+bool ThreadPool::TakeInjected_(Pool& pool, size_t index, Item& item) {
+    if(TakeOverflow_(pool, index, item)) return true;
+    Worker& self = *pool.workers[index];
+    size_t batch = 1 + min(INJECT_BATCH, pool.injected.size() / pool.workers.size());
+    if(pool.injected.try_pop_n(self.batch, batch) == 0) return false;
+    item = std::move(self.batch[0]);
+    bool full = false;
+    for(size_t i = 1; i < self.batch.size(); i++) {
+        full = full || !self.tasks.Push(std::move(self.batch[i]));
+        if(full) PushOverflow_(pool, std::move(self.batch[i]));
+    }
+    self.batch.clear();
+    return true;
+}
+
+//从随机位置开始把其他线程都试一遍
+bool ThreadPool::StealTask_(Pool& pool, size_t index, Item& item) {
+    size_t count = pool.workers.size();
+    if(count <= 1) return false;
+    Worker& self = *pool.workers[index];
+    self.seed ^= self.seed << 13;
+    self.seed ^= self.seed >> 17;
+    self.seed ^= self.seed << 5;
+    size_t start = self.seed % count;
+    for(size_t i = 0; i < count; i++) {
+        size_t victim = (start + i) % count;
+        if(victim == index) continue;
+        if(pool.workers[victim]->tasks.Steal(item)) {
+            self.steals.store(self.steals.load(memory_order_relaxed) + 1, memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::FindTask_(Pool& pool, size_t index, Item& item) {
+    return pool.workers[index]->tasks.Pop(item)
+        || TakeInjected_(pool, index, item)
+        || StealTask_(pool, index, item);
+}
+
+bool ThreadPool::HasWork_(Pool& pool) {
+    if(!pool.injected.empty() || pool.overflowSize.load(memory_order_relaxed) > 0) return true;
+    for(auto& worker : pool.workers) {
+        if(!worker->tasks.Empty()) return true;
+    }
+    return false;
+}
+
+void ThreadPool::OnFinish_(Pool& pool, unsigned long long runUs) {
+    pool.runUsTotal.fetch_add(runUs, memory_order_relaxed);
+    unsigned long long maxUs = pool.runUsMax.load(memory_order_relaxed);
+    while(runUs > maxUs && !pool.runUsMax.compare_exchange_weak(maxUs, runUs, memory_order_relaxed)) {}
+}
+
+/*调用时持有 pool.mtx。编号超出 target 的线程本地队列空了就退出；
+关闭后没有任务了、或者过了排空期限就退出，剩下的任务由 Shutdown 丢弃。*/
+bool ThreadPool::ShouldExit_(Pool& pool, size_t index) {
+    if(index >= pool.target.load(memory_order_relaxed) && pool.workers[index]->tasks.Empty()) return true;
+    if(!pool.isClosed.load(memory_order_relaxed)) return false;
+    return !HasWork_(pool) || (pool.deadlineUs >= 0 && NowUs_() > pool.deadlineUs);
+}
+
+/*两次任务之间的时间（找活、自旋、睡眠）算空闲，执行任务的时间算忙碌，每个任务只读两次时钟。*/
+void ThreadPool::WorkerLoop_(shared_ptr<Pool> pool, size_t index) {
+    tlsPool = pool.get();
+    tlsIndex = index;
+    Worker& self = *pool->workers[index];
+    Item item;
+    long long lastUs = NowUs_();
+    while(true) {
+        //要退出的线程只做自己本地队列里的任务
+        bool retiring = index >= pool->target.load(memory_order_relaxed);
+        bool found = retiring ? self.tasks.Pop(item) : FindTask_(*pool, index, item);
+        for(int i = 0; !found && !retiring && i < SPIN_ROUNDS; i++) {
+            this_thread::yield();
+            found = FindTask_(*pool, index, item);
+        }
+        if(found) {
+            long long startUs = NowUs_();
+            if(pool->isClosed.load(memory_order_acquire) && pool->deadlineUs >= 0 && startUs > pool->deadlineUs) {
+                item.task = nullptr;    //过了排空期限
+                pool->pending.fetch_sub(1, memory_order_relaxed);
+                pool->dropped.fetch_add(1, memory_order_relaxed);
+                continue;
+            }
+            OnDequeue_(*pool, item, startUs);
+            item.task();
+            item.task = nullptr;
+            long long endUs = NowUs_();
+            OnFinish_(*pool, endUs - startUs);
+            self.taskCount.store(self.taskCount.load(memory_order_relaxed) + 1, memory_order_relaxed);
+            self.idleUs.store(self.idleUs.load(memory_order_relaxed) + (startUs - lastUs), memory_order_relaxed);
+            self.busyUs.store(self.busyUs.load(memory_order_relaxed) + (endUs - startUs), memory_order_relaxed);
+            lastUs = endUs;
+            continue;
+        }
+
+        unique_lock<mutex> locker(pool->mtx);
+        pool->sleeping.fetch_add(1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if(ShouldExit_(*pool, index)) {
+            pool->sleeping.fetch_sub(1, memory_order_relaxed);
+            self.running = false;
+            break;
+        }
+        if(!HasWork_(*pool)) pool->cond.wait(locker);
+        pool->sleeping.fetch_sub(1, memory_order_relaxed);
+    }
+    self.idleUs.store(self.idleUs.load(memory_order_relaxed) + (NowUs_() - lastUs), memory_order_relaxed);
+    tlsPool = nullptr;
+}
@@ -4,16 +4,30 @@ WebServer::WebServer(
         int port, int trigMode, int timeoutMs, bool OptLinger,
         int sqlPort, const char* sqlUser, const char* sqlPwd,
         const char* dbname, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int LogQueSize):
+        bool openLog, int logLevel, int LogQueSize, const ServerOptions& options):
         port_(port), openLinger_(OptLinger), timeoutMs_(timeoutMs), isClose_(false),
-        timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller())
+        minThreadNum_(threadNum), maxThreadNum_(std::max(threadNum, options.pool.maxThreadNum)), lastTuneMs_(0), lastBusyUs_(0),
+        shrinkIdleMs_(options.readBuffer.idleMs), lastReleaseMs_(0),
+        timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum, maxThreadNum_)), epoller_(new Epoller())
 {
+    /* 先绑核，之后预加载、错误页和连接对象的内存都在事件循环所在的节点上首次分配 */
+    Affinity::PinSelf(Affinity::Parse(options.cpus.loop));
     srcDir_ = getcwd(nullptr, 256);
     //std::cout << srcDir_ << std::endl;
     assert(srcDir_);
     strncat(srcDir_, "/resources/", 16);
     HttpConn::userCount = 0;
     HttpConn::srcDir = srcDir_;
+    const ServerOptions::Pool& pool = options.pool;
+    CompressCache::Instance()->Init(options.compress.level);
+    OutputQueue::SetZeroCopyThreshold(options.resource.zeroCopyThreshold);
+    ChainBuffer::SetShrinkPolicy(options.readBuffer.keepBytes, options.readBuffer.idleMs);
+    threadpool_->SetQueueLimit(pool.queueLimit, pool.overloadPolicy);
+    if(pool.blockingThreadNum > 0){
+        /* 线程数就是同时访问数据库的请求数上限，排队上限和过载策略与普通任务相同 */
+        blockingPool_.reset(new ThreadPool(pool.blockingThreadNum));
+        blockingPool_->SetQueueLimit(pool.queueLimit, pool.overloadPolicy);
+    }
     SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbname, connPoolNum);
     InitEventMode_(trigMode);
     if(!InitSocket_()) { isClose_ = true; }
@@ -21,6 +35,7 @@ WebServer::WebServer(
     if(openLog){
         //std::cout<< LogQueSize << std::endl;
         Log::Instance()->init(logLevel, "./log", ".log", LogQueSize);
+        Log::Instance()->SetFlushPolicy(options.logFlush.policy, options.logFlush.value);
         //Log::Instance()->SetLevel(logLevel);
         if(isClose_) { LOG_ERROR("============Server Init Error!============")}
         else{
@@ -29,20 +44,72 @@ WebServer::WebServer(
             LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
                             (listenEvent_ & EPOLLET ? "ET": "LT"),
                             (connEvent_ & EPOLLET ? "ET": "LT"));
-            LOG_INFO("LogSys level: %d", logLevel);
+            LOG_INFO("LogSys level: %d, flush policy: %d, value: %d", logLevel,
+                            (int)options.logFlush.policy, options.logFlush.value);
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
-            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d, max: %d, blocking: %d",
+                        connPoolNum, threadNum, (int)maxThreadNum_, pool.blockingThreadNum);
+            LOG_INFO("Compress level: %d", options.compress.level);
+            LOG_INFO("ZeroCopy threshold: %d", (int)options.resource.zeroCopyThreshold);
+            LOG_INFO("ReadBuffer keep: %d, idle: %dms", (int)options.readBuffer.keepBytes, options.readBuffer.idleMs);
+            LOG_INFO("Task queue limit: %d, overload policy: %d", (int)pool.queueLimit, (int)pool.overloadPolicy);
         }
     }
+    InitAffinity_(options.cpus);
+
+    if(options.compress.precompress && !isClose_){
+        /* 离线生成 .gz 预压缩副本，运行期只做选择不做压缩 */
+        int count = ContentCoding::PrecompressDir(srcDir_);
+        LOG_INFO("Precompress: %d files generated", count);
+    }
+    if(options.resource.preload && !isClose_){
+        /* 预压缩之后再预加载，副本也一起放进内存 */
+        ResourceBundle::Instance()->Load(srcDir_);
+    }
+    ErrorPage::Instance()->Init(srcDir_);
 }
 
+/*先关闭线程池：排队的任务在期限内做完，正在执行的任务结束后才继续析构，任务里用到的成员都还有效。
+普通任务会把请求转到阻塞任务的线程池，所以先关普通的，再关阻塞的。*/
 WebServer::~WebServer(){
+    size_t dropped = threadpool_->Shutdown(DRAIN_MS);
+    LogPoolStats_("fast", *threadpool_, dropped);
+    if(blockingPool_){
+        dropped = blockingPool_->Shutdown(DRAIN_MS);
+        LogPoolStats_("blocking", *blockingPool_, dropped);
+    }
+    if(OutputQueue::ZeroCopyThreshold() > 0){
+        OutputQueue::ZeroCopyStats stats = OutputQueue::GetZeroCopyStats();
+        LOG_INFO("ZeroCopy sends: %llu, bytes: %llu, completed: %llu, copied: %llu",
+                    stats.sends, stats.bytes, stats.completed, stats.copied);
+    }
     close(listenFd_);
     isClose_ = true;
     free(srcDir_);
     SqlConnPool::Instance()->ClosePool();
 }
 
+/*事件循环在构造函数开始时已经绑好。工作线程没有单独配置时，绑到事件循环所在 NUMA 节点上的其余核：
+连接对象由事件循环创建，读写缓冲区的块由工作线程从各自的内存池分配，两边在同一个节点上就不会跨节点访问。
+只有一个事件循环，所有连接都从同一个 epoll 分发，没有按网卡队列（RSS/XPS）拆分事件循环。*/
+void WebServer::InitAffinity_(const ServerOptions::Cpus& cpus){
+    std::vector<int> loop = Affinity::Parse(cpus.loop);
+    std::vector<int> workers = Affinity::Parse(cpus.worker);
+    if(workers.empty() && !loop.empty()){
+        std::vector<int> node = Affinity::NodeCpus(Affinity::NodeOf(loop[0]));
+        for(int cpu : node){
+            if(std::find(loop.begin(), loop.end(), cpu) == loop.end()) workers.push_back(cpu);
+        }
+        if(workers.empty()) workers = node;
+    }
+    threadpool_->SetAffinity(workers);
+    if(blockingPool_) blockingPool_->SetAffinity(workers);
+    std::vector<int> writer = Affinity::Parse(cpus.log);
+    bool logPinned = Log::Instance()->SetAffinity(writer);
+    LOG_INFO("Affinity loop: [%s], workers: [%s], log: [%s]", Affinity::ToString(loop).c_str(),
+                Affinity::ToString(workers).c_str(), logPinned ? Affinity::ToString(writer).c_str() : "");
+}
+
 /*这段代码是WebServer类的一个函数InitEventMode_，它会根据传入的参数trigMode的值来初始化监听套接字和连接套接字的事件模式。
 根据trigMode的值，可能会设置EPOLLET（边缘触发）和EPOLLONESHOT（一次性事件）标志。
 在函数中还有一行代码，将HttpConn类的静态变量isET设置为连接套接字事件中是否设置了EPOLLET标志。*/
@@ -88,7 +155,21 @@ void WebServer::Start(){
             timeMS = timer_->GetNextTick();
         }
 
+        if(maxThreadNum_ > minThreadNum_ && (timeMS < 0 || timeMS > TUNE_INTERVAL_MS)){
+            timeMS = TUNE_INTERVAL_MS;  //没有事件时也要按时调整线程数
+        }
+        if(shrinkIdleMs_ >= 0 && (timeMS < 0 || timeMS > RELEASE_INTERVAL_MS)){
+            timeMS = RELEASE_INTERVAL_MS;   //连接都空闲时也要按时回收缓冲
+        }
+
         int eventCnt = epoller_->Wait(timeMS);
+        CoarseClock::Instance()->Update();  //每轮只读一次时钟，本轮的定时器、Date 头和日志时间都用它
+        if(maxThreadNum_ > minThreadNum_){
+            TunePool_();
+        }
+        if(shrinkIdleMs_ >= 0){
+            ReleaseIdle_();
+        }
 
         for(int i = 0; i < eventCnt; i++){
             //处理事件
@@ -98,6 +179,13 @@ void WebServer::Start(){
             if(fd == listenFd_){
                 DealListen_();
             }
+            else if((events & EPOLLERR) && !(events & (EPOLLRDHUP | EPOLLHUP))
+                    && users_.count(fd) > 0 && users_[fd].ReapZeroCopy()){
+                //只是零拷贝的完成通知：同时有读写事件就照常处理，否则重新注册原来等待的事件
+                if(events & EPOLLIN) DealRead_(&users_[fd]);
+                else if(events & EPOLLOUT) DealWrite_(&users_[fd]);
+                else epoller_->ModFd(fd, connEvent_ | (users_[fd].ToWriteBytes() > 0 ? EPOLLOUT : EPOLLIN));
+            }
             else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
                 assert(users_.count(fd) > 0);
                 CloseConn_(&users_[fd]);
@@ -129,6 +217,68 @@ void WebServer::SendError_(int fd, const char* info){
     close(fd);
 }
 
+/*每秒看一次线程池：排队的任务比线程多就加一个线程；没有排队、且上个间隔里线程的忙碌时间不到四分之一就减一个。
+线程数在启动时的 threadNum 和 maxThreadNum 之间。*/
+void WebServer::TunePool_(){
+    long long now = CoarseClock::Instance()->NowMs();
+    if(now - lastTuneMs_ < TUNE_INTERVAL_MS) return;
+    unsigned long long busyUs = 0;
+    for(const ThreadPool::WorkerStats& stats : threadpool_->GetWorkerStats()){
+        busyUs += stats.busyUs;
+    }
+    size_t threads = threadpool_->ThreadCount();
+    size_t depth = threadpool_->GetQueueStats().depth;
+    double busyRatio = lastTuneMs_ > 0 ? (busyUs - lastBusyUs_) / ((now - lastTuneMs_) * 1000.0 * threads) : 1.0;
+    lastTuneMs_ = now;
+    lastBusyUs_ = busyUs;
+
+    if(depth > threads && threads < maxThreadNum_){
+        threadpool_->Resize(threads + 1);
+        LOG_INFO("ThreadPool grow to %d, queue depth: %d", (int)threads + 1, (int)depth);
+    }
+    else if(depth == 0 && busyRatio < 0.25 && threads > minThreadNum_){
+        threadpool_->Resize(threads - 1);
+        LOG_INFO("ThreadPool shrink to %d, busy: %d%%", (int)threads - 1, (int)(busyRatio * 100));
+    }
+}
+
+/*收缩策略原本只在读缓冲被取空时检查，一直没有新请求的长连接会一直占着为上一个大请求借的块。
+每秒在事件循环里把所有连接过一遍，归还空闲够久的块；已关闭还没被复用的连接对象也在这里归还缓冲。*/
+void WebServer::ReleaseIdle_(){
+    long long now = CoarseClock::Instance()->NowMs();
+    if(now - lastReleaseMs_ < RELEASE_INTERVAL_MS) return;
+    lastReleaseMs_ = now;
+    for(auto& user : users_){
+        user.second.ReleaseIdle();
+    }
+}
+
+void WebServer::LogPoolStats_(const char* lane, ThreadPool& pool, size_t dropped){
+    std::vector<ThreadPool::WorkerStats> workers = pool.GetWorkerStats();
+    for(size_t i = 0; i < workers.size(); i++){
+        if(workers[i].tasks == 0 && workers[i].idleUs == 0) continue;  //没有启动过
+        LOG_INFO("[%s] Worker[%d] tasks: %llu, steals: %llu, busy: %llums, idle: %llums", lane, (int)i,
+                    workers[i].tasks, workers[i].steals, workers[i].busyUs / 1000, workers[i].idleUs / 1000);
+    }
+    ThreadPool::QueueStats queue = pool.GetQueueStats();
+    unsigned long long executed = queue.executed ? queue.executed : 1;
+    LOG_INFO("[%s] TaskQueue submitted: %llu, rejected: %llu, blocked: %llu, dropped: %d, peak depth: %d",
+                lane, queue.submitted, queue.rejected, queue.blocked, (int)dropped, (int)queue.peakDepth);
+    LOG_INFO("[%s] Task wait avg: %lluus, max: %lluus, run avg: %lluus, max: %lluus", lane,
+                queue.waitUsTotal / executed, queue.waitUsMax, queue.runUsTotal / executed, queue.runUsMax);
+}
+
+/*任务被线程池拒绝，policy 是拒绝它的那个线程池的策略：REJECT 直接关闭，其余先回 503 再关闭。
+BLOCK 策略下 AddTask 不会失败，只有跨线程池转交时 TryAddTask 不等待才会被拒绝，这时同样回 503。事件循环和工作线程都可能调用*/
+void WebServer::OnOverload_(HttpConn* client, ThreadPool::OVERLOAD policy){
+    assert(client);
+    LOG_WARN("Client[%d] overload, policy: %d", client->GetFD(), (int)policy);
+    if(policy != ThreadPool::REJECT){
+        client->Shed();
+    }
+    CloseConn_(client);
+}
+
 void WebServer::CloseConn_(HttpConn* client){
     assert(client);
     LOG_INFO("Client[%d] quit!", client->GetFD());
@@ -166,14 +316,21 @@ void WebServer::DealListen_(){
 void WebServer::DealRead_(HttpConn* client){
     assert(client);
     ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
+    //新请求受线程池排队上限限制，过载时在事件循环里直接处理
+    client->BeginTask();
+    if(!threadpool_->AddTask([this, client] { OnRead_(client); client->EndTask(); })){
+        client->EndTask();
+        OnOverload_(client, threadpool_->Policy());
+    }
 
 }
 
 void WebServer::DealWrite_(HttpConn* client){
     assert(client);
     ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+    //写事件是已经接受的请求的后续，丢掉只会浪费已经做完的工作，不受排队上限限制
+    client->BeginTask();
+    threadpool_->AddTaskUnbounded([this, client] { OnWrite_(client); client->EndTask(); });
 
 }
 void WebServer::ExtentTime_(HttpConn* client) {
@@ -191,6 +348,21 @@ void WebServer::OnRead_(HttpConn* client){
         CloseConn_(client);
         return ;
     }
+    ProcessOnLane_(client);
+}
+
+/*可能访问数据库的请求（POST）转到阻塞任务的线程池，一批登录请求最多占满那几个线程，静态资源的请求不会排在它们后面。
+转过去时受那个线程池的排队上限限制，但不等待：转交的是快线程池的工作线程，等下去静态资源的请求又会被登录请求挡住。
+超过上限时按过载处理。*/
+void WebServer::ProcessOnLane_(HttpConn* client){
+    if(blockingPool_ && client->MayBlock()){
+        client->BeginTask();
+        if(!blockingPool_->TryAddTask([this, client] { OnProcess(client); client->EndTask(); })){
+            client->EndTask();
+            OnOverload_(client, blockingPool_->Policy());
+        }
+        return;
+    }
     OnProcess(client);
 }
 
@@ -201,7 +373,7 @@ void WebServer::OnWrite_(HttpConn* client){
     ret = client->write(&writeErrno);
     if(client->ToWriteBytes() == 0){
         if(client->isKeepAlive()){
-            OnProcess(client);
+            ProcessOnLane_(client);
             return;
         }
     }
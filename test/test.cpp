@@ -5,7 +5,13 @@
  */ 
 #include "log.h"
 #include "threadpool.h"
+#include "blockqueue.h"
+#include "mpmcqueue.h"
+#include "outputqueue.h"
+#include "chainbuffer.h"
 #include <features.h>
+#include <chrono>
+#include <iostream>
 
 #if __GLIBC__ == 2 && __GLIBC_MINOR__ < 30
 #include <sys/syscall.h>
@@ -52,7 +58,654 @@ void TestThreadPool() {
     //getchar();
 }
 
+/*"\r\n" 分在两块、一行跨三块时，FindCRLF 都要把整行拼进第一块，返回的位置指向 "\r"；
+解析器取走这一行后，剩下的数据顺序不变。*/
+void TestChainBuffer() {
+    ChainBuffer buff(2 * 1024);
+    std::string first(2047, 'a');
+    buff.Append(first + "\r");           //正好填满第一块，"\n" 落到下一块
+    buff.Append("\nGET / HTTP/1.1\r\n");
+    assert(buff.ReadableBytes() == 2048 + 17);
+    const char* crlf = buff.FindCRLF();
+    assert(crlf && crlf - buff.Peek() == 2047);
+    assert(crlf[0] == '\r' && crlf[1] == '\n' && crlf + 2 <= buff.PeekEnd());
+    assert(std::string(buff.Peek(), crlf) == first);
+    buff.RetrieveUntil(crlf + 2);
+
+    crlf = buff.FindCRLF();
+    assert(crlf && std::string(buff.Peek(), crlf) == "GET / HTTP/1.1");
+    buff.RetrieveUntil(crlf + 2);
+    assert(buff.ReadableBytes() == 0 && buff.FindCRLF() == nullptr);
+
+    std::string line;
+    for(int i = 0; i < 5000; i++) line += static_cast<char>('a' + i % 26);
+    for(size_t i = 0; i < line.size(); i += 1000) {
+        buff.Append(line.substr(i, 1000));
+    }
+    assert(buff.FindCRLF() == nullptr);  //没有完整的一行时什么都不做
+    buff.Append("\r\nX");
+    crlf = buff.FindCRLF();
+    assert(crlf && std::string(buff.Peek(), crlf) == line);
+    buff.RetrieveUntil(crlf + 2);
+    assert(buff.ReadableBytes() == 1 && *buff.Peek() == 'X');
+    std::cout << "ChainBuffer ok" << std::endl;
+}
+
+//非阻塞地把对端已经到达的数据都读进 received
+static void DrainSocket(int fd, std::string& received) {
+    char buff[64 * 1024];
+    ssize_t n;
+    while((n = read(fd, buff, sizeof(buff))) > 0) {
+        received.append(buff, n);
+    }
+}
+
+/*发送缓冲区只有几 KB，每次 WriteFd 都只能写出一部分，而且可能停在任何片段的中间：
+自己的块、引用的内存、文件片段交替排队，每次 EAGAIN 后把对端读空再继续，收到的字节必须和入队的顺序完全一致，
+引用的片段发送完后立即释放 holder。*/
+static void TestOutputQueueShortWrite() {
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    int sndBuf = 4096;
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndBuf, sizeof(sndBuf));
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+
+    char path[] = "/tmp/outputqueueXXXXXX";
+    int fileFd = mkstemp(path);
+    assert(fileFd >= 0);
+    unlink(path);
+    std::string file(100000, '\0');
+    for(size_t i = 0; i < file.size(); i++) file[i] = static_cast<char>('a' + i % 26);
+    assert(write(fileFd, file.data(), file.size()) == static_cast<ssize_t>(file.size()));
+
+    auto body = std::make_shared<std::string>(300000, 'r');
+    OutputQueue output;
+    std::string expected = "HTTP/1.1 200 OK\r\n";
+    output.Append(expected);
+    output.AppendRef(body->data(), body->size(), body);
+    expected += *body;
+    output.Append("Connection: keep-alive\r\n");
+    expected += "Connection: keep-alive\r\n";
+    output.AppendFile(fileFd, 10, 90000);
+    expected += file.substr(10, 90000);
+    output.Append("END");
+    expected += "END";
+    assert(output.Bytes() == expected.size());
+
+    std::string received;
+    size_t sent = 0;
+    int shortWrites = 0;
+    while(!output.Empty()) {
+        int saveErrno = 0;
+        ssize_t n = output.WriteFd(sv[0], &saveErrno);
+        if(n < 0) {
+            assert(saveErrno == EAGAIN);
+            shortWrites++;
+            DrainSocket(sv[1], received);
+            continue;
+        }
+        sent += n;
+        assert(output.Bytes() == expected.size() - sent);
+    }
+    DrainSocket(sv[1], received);
+    assert(shortWrites > 0);
+    assert(received == expected);
+    assert(body.use_count() == 1);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+/*打开零拷贝后，大的引用片段要保留到内核发回完成通知；通知收齐后 holder 只剩调用方这一份。
+环回上内核会退回拷贝，但同样会发通知。内核不支持 SO_ZEROCOPY 时跳过。*/
+static void TestOutputQueueZeroCopy() {
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    assert(bind(listenFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+    assert(listen(listenFd, 1) == 0);
+    getsockname(listenFd, reinterpret_cast<struct sockaddr*>(&addr), &addrLen);
+    int sendFd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(sendFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+    int recvFd = accept(listenFd, nullptr, nullptr);
+    fcntl(sendFd, F_SETFL, fcntl(sendFd, F_GETFL) | O_NONBLOCK);
+    fcntl(recvFd, F_SETFL, fcntl(recvFd, F_GETFL) | O_NONBLOCK);
+
+    int on = 1;
+    if(setsockopt(sendFd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) != 0) {
+        std::cout << "OutputQueue zerocopy skipped" << std::endl;
+    }
+    else {
+        OutputQueue::SetZeroCopyThreshold(64 * 1024);
+        auto body = std::make_shared<std::string>(256 * 1024, 'z');
+        OutputQueue output;
+        output.EnableZeroCopy(true);
+        output.Append("HEAD");
+        output.AppendRef(body->data(), body->size(), body);
+        std::string received;
+        while(!output.Empty()) {
+            int saveErrno = 0;
+            if(output.WriteFd(sendFd, &saveErrno) < 0) {
+                assert(saveErrno == EAGAIN || saveErrno == ENOBUFS);
+            }
+            DrainSocket(recvFd, received);
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while(output.ZeroCopyPending() > 0 && std::chrono::steady_clock::now() < deadline) {
+            DrainSocket(recvFd, received);
+            output.ReapZeroCopy(sendFd);
+        }
+        DrainSocket(recvFd, received);
+        assert(received == "HEAD" + *body);
+        assert(output.ZeroCopyPending() == 0);
+        assert(body.use_count() == 1);
+        OutputQueue::SetZeroCopyThreshold(0);
+    }
+    close(sendFd);
+    close(recvFd);
+    close(listenFd);
+}
+
+void TestOutputQueue() {
+    TestOutputQueueShortWrite();
+    TestOutputQueueZeroCopy();
+    std::cout << "OutputQueue ok" << std::endl;
+}
+
+/*所有者在底部 Push / Pop，三个窃取者同时从顶部 Steal，本地队列满了所有者就先 Pop 一个。
+每个元素必须恰好被取走一次：不丢、不重复，包括所有者和窃取者抢最后一个元素的情况。*/
+void TestWorkStealDeque() {
+    {
+        WorkStealDeque<int, 64> deq;
+        for(int i = 1; i <= 64; i++) assert(deq.Push(int(i)));
+        assert(!deq.Push(65));
+        int item = 0;
+        assert(deq.Steal(item) && item == 1);    //窃取者先进先出
+        assert(deq.Pop(item) && item == 64);     //所有者后进先出
+        for(int i = 63; i >= 2; i--) assert(deq.Pop(item) && item == i);
+        assert(!deq.Pop(item) && !deq.Steal(item) && deq.Empty());
+    }
+
+    const int N = 200000, THIEVES = 3;
+    WorkStealDeque<int, 64> deq;
+    std::vector<std::atomic<int>> taken(N);
+    for(auto& t : taken) t.store(0);
+    std::atomic<bool> done(false);
+    std::vector<std::thread> thieves;
+    for(int i = 0; i < THIEVES; i++) {
+        thieves.emplace_back([&] {
+            int item;
+            while(!done.load()) {
+                if(deq.Steal(item)) taken[item]++;
+            }
+        });
+    }
+    int item;
+    for(int i = 0; i < N; i++) {
+        while(!deq.Push(int(i))) {
+            if(deq.Pop(item)) taken[item]++;
+        }
+        if(i % 2 == 0 && deq.Pop(item)) taken[item]++;
+    }
+    while(deq.Pop(item)) taken[item]++;     //不再 Push，Pop 失败说明已经空了
+    done = true;
+    for(auto& t : thieves) t.join();
+    for(int i = 0; i < N; i++) assert(taken[i].load() == 1);
+    std::cout << "WorkStealDeque ok" << std::endl;
+}
+
+//调用时记下自己的地址：放在 Task 内部的对象移动后地址跟着变，放在堆上的对象地址不变
+template<size_t PAD>
+struct TaskProbe {
+    std::shared_ptr<int> token;     //use_count 反映还有几份可调用对象活着
+    const void** seen;
+    char pad[PAD];
+    void operator()() { *seen = this; }
+};
+
+struct ThrowingMoveProbe {
+    std::shared_ptr<int> token;
+    const void** seen;
+    ThrowingMoveProbe(std::shared_ptr<int> t, const void** s): token(std::move(t)), seen(s) {}
+    ThrowingMoveProbe(ThrowingMoveProbe&& other): token(std::move(other.token)), seen(other.seen) {}  //没有 noexcept
+    void operator()() { *seen = this; }
+};
+
+static bool InsideTask(const Task& task, const void* p) {
+    const char* begin = reinterpret_cast<const char*>(&task);
+    return p >= begin && p < begin + sizeof(Task);
+}
+
+/*小的可调用对象放在 Task 内部，移动时跟着搬过去；大的、移动可能抛异常的放在堆上，移动只转交指针。
+两种情况下移动后原 Task 都变空，可调用对象既不被拷贝也不泄漏，赋值和置空时旧对象被析构。*/
+void TestTask() {
+    static_assert(sizeof(Task) == 64, "Task should fill one cache line");
+    auto token = std::make_shared<int>(0);
+    const void* seen = nullptr;
+
+    Task small(TaskProbe<8>{token, &seen, {}});
+    assert(token.use_count() == 2);
+    small();
+    assert(InsideTask(small, seen));
+    Task movedSmall(std::move(small));
+    assert(!small && movedSmall && token.use_count() == 2);
+    movedSmall();
+    assert(InsideTask(movedSmall, seen));
+
+    Task large(TaskProbe<64>{token, &seen, {}});
+    assert(token.use_count() == 3);
+    large();
+    const void* heap = seen;
+    assert(!InsideTask(large, heap));
+    Task movedLarge;
+    movedLarge = std::move(large);
+    assert(!large && movedLarge && token.use_count() == 3);
+    movedLarge();
+    assert(seen == heap);
+
+    Task throwing(ThrowingMoveProbe(token, &seen));
+    throwing();
+    assert(!InsideTask(throwing, seen) && token.use_count() == 4);
+
+    movedLarge = std::move(movedSmall);     //旧的堆上对象被析构
+    assert(token.use_count() == 3);
+    movedLarge();
+    assert(InsideTask(movedLarge, seen));
+    movedLarge = nullptr;
+    throwing = nullptr;
+    assert(!movedLarge && token.use_count() == 1);
+    std::cout << "Task ok" << std::endl;
+}
+
+/*4 个生产者往容量只有 64 的队列里各放 50000 个互不相同的数，队列经常是满的，push_back 要在 futex 上等；
+一半消费者用阻塞的 pop，一半用 try_pop_n 成批取。每个数必须恰好被取走一次，
+同一个消费者看到的同一个生产者的数保持入队顺序。关闭后先取完剩下的元素，再返回 false。*/
+void TestMpmcQueue() {
+    const int PRODUCERS = 4, CONSUMERS = 4, N = 50000, TOTAL = PRODUCERS * N;
+    std::unique_ptr<MpmcQueue<int>> queue(new MpmcQueue<int>(64));
+    assert(reinterpret_cast<uintptr_t>(queue.get()) % CacheAligned::CACHE_LINE == 0);
+    MpmcQueue<int>& q = *queue;
+    std::vector<std::atomic<int>> taken(TOTAL);
+    for(auto& t : taken) t.store(0);
+    std::atomic<int> consumed(0);
+    std::atomic<bool> ordered(true);
+
+    std::vector<std::thread> threads;
+    for(int c = 0; c < CONSUMERS; c++) {
+        threads.emplace_back([&, c] {
+            std::vector<int> last(PRODUCERS, -1);
+            std::vector<int> batch;
+            auto take = [&](int item) {
+                taken[item]++;
+                int p = item / N;
+                if(item <= last[p]) ordered = false;
+                last[p] = item;
+                consumed++;
+            };
+            while(consumed.load() < TOTAL) {
+                int item;
+                if(c % 2 == 0) {
+                    if(q.pop(item, 1)) take(item);
+                }
+                else {
+                    batch.clear();
+                    if(q.try_pop_n(batch, 16) == 0) std::this_thread::yield();
+                    for(int i : batch) take(i);
+                }
+            }
+        });
+    }
+    for(int p = 0; p < PRODUCERS; p++) {
+        threads.emplace_back([&q, p] {
+            for(int i = 0; i < N; i++) q.push_back(p * N + i);
+        });
+    }
+    for(auto& t : threads) t.join();
+    assert(consumed.load() == TOTAL && ordered.load() && q.empty());
+    for(int i = 0; i < TOTAL; i++) assert(taken[i].load() == 1);
+
+    for(int i = 0; i < 3; i++) assert(q.try_push(i));
+    q.Close();
+    int item;
+    for(int i = 0; i < 3; i++) assert(q.pop(item) && item == i);
+    assert(!q.pop(item));
+    std::cout << "MpmcQueue ok" << std::endl;
+}
+
+/*单线程先检查边界：Reserve 不跨过环尾、Append 绕回时分两段写、放不下时什么都不写，Peek 绕回时给出两段 iovec。
+再让一个生产者按不定长度写入连续的字节序列，消费者边取边核对，环绕回很多次后字节顺序不能乱。*/
+void TestLogRing() {
+    {
+        LogRing ring(64);
+        assert(ring.Capacity() == 64);
+        char* dst = ring.Reserve(40);
+        assert(dst);
+        memset(dst, 'a', 40);
+        ring.Commit(40);
+        struct iovec iov[2];
+        int n = 0;
+        assert(ring.Peek(iov, &n) == 40 && n == 1);
+        ring.Retrieve(30);
+        assert(ring.Reserve(30) == nullptr);    //连续空间只剩 24 字节
+        assert(!ring.Append(std::string(55, 'x').data(), 55));  //总空间只有 54 字节
+        assert(ring.Append("0123456789012345678901234567890123456789", 40));    //绕回
+        assert(ring.Peek(iov, &n) == 50 && n == 2);
+        assert(iov[0].iov_len == 34 && iov[1].iov_len == 16);
+        assert(memcmp(static_cast<char*>(iov[0].iov_base) + 10, "012345678901234567890123", 24) == 0);
+        assert(memcmp(iov[1].iov_base, "4567890123456789", 16) == 0);
+        ring.Retrieve(50);
+        assert(ring.ReadableBytes() == 0 && !ring.IsClosed());
+        ring.Close();
+        assert(ring.IsClosed());
+    }
+
+    const size_t TOTAL = 4 * 1024 * 1024;
+    std::unique_ptr<LogRing> ring(new LogRing(1024));
+    assert(reinterpret_cast<uintptr_t>(ring.get()) % CacheAligned::CACHE_LINE == 0);
+    std::thread producer([&ring, TOTAL] {
+        char chunk[97];
+        size_t next = 0;
+        unsigned seed = 1;
+        while(next < TOTAL) {
+            seed = seed * 1103515245 + 12345;
+            size_t len = std::min<size_t>(1 + seed % sizeof(chunk), TOTAL - next);
+            for(size_t i = 0; i < len; i++) chunk[i] = static_cast<char>((next + i) % 251);
+            char* dst = (seed & 1) ? ring->Reserve(len) : nullptr;
+            if(dst) {
+                memcpy(dst, chunk, len);
+                ring->Commit(len);
+            }
+            else {
+                while(!ring->Append(chunk, len)) std::this_thread::yield();
+            }
+            next += len;
+        }
+        ring->Close();
+    });
+    size_t got = 0;
+    bool ok = true;
+    while(true) {
+        bool closed = ring->IsClosed();     //先看关闭再取，关闭前写入的都能取到
+        struct iovec iov[2];
+        int n = 0;
+        size_t len = ring->Peek(iov, &n);
+        for(int j = 0; j < n; j++) {
+            const char* p = static_cast<const char*>(iov[j].iov_base);
+            for(size_t i = 0; i < iov[j].iov_len; i++, got++) {
+                ok = ok && p[i] == static_cast<char>(got % 251);
+            }
+        }
+        ring->Retrieve(len);
+        if(len == 0) {
+            if(closed) break;
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    assert(ok && got == TOTAL);
+    std::cout << "LogRing ok" << std::endl;
+}
+
+/*push_back(T&&) 和 emplace_back 把字符串移进队列，调用方手里的对象被移空；pop 把元素移给调用方，不留拷贝。
+pop_all 一次取走全部元素，try_pop_n 最多取 n 个，取完后队列是空的，顺序和入队一致；
+另一个线程在队列满时阻塞的 push_back，在批量取走后能继续。*/
+void TestBlockDeque() {
+    const std::string line(96, 'x');     //超过短字符串优化的长度，移动后原对象一定是空的
+    BlockDeque<std::string> deq(8);
+    std::string str(line);
+    deq.push_back(std::move(str));
+    assert(str.empty());
+    deq.emplace_back(3, 'y');
+    deq.push_back(static_cast<const std::string&>(line));
+    std::string item;
+    assert(deq.pop(item) && item == line);
+    assert(deq.pop(item) && item == "yyy");
+    assert(deq.pop(item, 1) && item == line);
+    assert(deq.empty());
+
+    for(int i = 0; i < 8; i++) deq.push_back(std::to_string(i));
+    std::thread producer([&deq] {       //队列已满，等批量取走后才能放进去
+        for(int i = 8; i < 20; i++) deq.push_back(std::to_string(i));
+    });
+    std::vector<std::string> batch;
+    assert(deq.try_pop_n(batch, 3) == 3);
+    while(batch.size() < 20) {
+        assert(deq.pop_all(batch));
+    }
+    producer.join();
+    assert(deq.empty() && deq.try_pop_n(batch, 3) == 0);
+    for(int i = 0; i < 20; i++) assert(batch[i] == std::to_string(i));
+    std::cout << "BlockDeque ok" << std::endl;
+}
+
+/*连接的读缓冲曾经为一个大请求借过 size 大小的块，之后每个请求只有几百字节。
+长连接上每个请求结束时 RetrieveAll 只重置读写位置；连接关闭后复用时 HttpConn::init 调用
+output_.Clear() 和 readBuff_.Shrink() 把块还回内存池。两者的开销都应当和块的大小无关，
+bzero 一行是原来每次清零同样大小的开销，作为对照。*/
+void BenchBufferReset() {
+    const int rounds = 100000;
+    const char request[] = "GET /index.html HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+    for(size_t size : {2 * 1024, 64 * 1024, 1024 * 1024}) {
+        std::string big(size, 'b');
+        ChainBuffer buff;
+        buff.Append(big);
+        buff.RetrieveAll();
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < rounds; i++) {
+            buff.Append(request, sizeof(request) - 1);
+            buff.RetrieveAll();
+        }
+        auto reset = std::chrono::steady_clock::now() - start;
+
+        OutputQueue output;
+        std::chrono::steady_clock::duration shrink(0);
+        for(int i = 0; i < rounds / 100; i++) {
+            buff.Append(big);
+            output.Append(request, sizeof(request) - 1);
+            start = std::chrono::steady_clock::now();
+            output.Clear();
+            buff.Shrink();
+            shrink += std::chrono::steady_clock::now() - start;
+        }
+        shrink *= 100;
+
+        std::vector<char> zeroBuff(size);
+        start = std::chrono::steady_clock::now();
+        for(int i = 0; i < rounds / 100; i++) {
+            bzero(zeroBuff.data(), zeroBuff.size());
+        }
+        auto zero = (std::chrono::steady_clock::now() - start) * 100;
+        std::cout << "block " << size
+                  << ": append+RetrieveAll " << std::chrono::duration_cast<std::chrono::nanoseconds>(reset).count() / rounds
+                  << " ns/op, init Clear+Shrink " << std::chrono::duration_cast<std::chrono::nanoseconds>(shrink).count() / rounds
+                  << " ns/op, bzero " << std::chrono::duration_cast<std::chrono::nanoseconds>(zero).count() / rounds
+                  << " ns/op" << std::endl;
+    }
+}
+
+/*每个任务做一小段固定的计算，看 1 到 64 个工作线程时每秒能完成多少任务。
+任务都从主线程提交，走注入队列，再被工作线程分批取走、互相窃取。*/
+void BenchThreadPoolScaling() {
+    const int tasks = 200000;
+    for(size_t threads : {1, 2, 4, 8, 16, 32, 64}) {
+        std::atomic<int> done(0);
+        auto start = std::chrono::steady_clock::now();
+        {
+            ThreadPool pool(threads);
+            for(int i = 0; i < tasks; i++) {
+                pool.AddTask([&done] {
+                    volatile unsigned x = 0;
+                    for(int k = 0; k < 200; k++) x += k;
+                    done.fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+            while(done.load() < tasks) std::this_thread::yield();
+        }
+        auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "threads " << threads << ": " << tasks * 1000000LL / (cost ? cost : 1) << " tasks/s" << std::endl;
+    }
+}
+
+/*事件循环提交的任务形如 [this, client]{...}，再带上几个值的捕获也只有几十字节。
+对比 std::function 和 Task 构造、移动两次（进队列、出队列）再调用的耗时，以及 Task 放不下时走堆的情况。*/
+template<class Fn, class F>
+long long BenchTaskOnce(const F& f, int rounds) {
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < rounds; i++) {
+        Fn a(f);
+        Fn b(std::move(a));
+        Fn c;
+        c = std::move(b);
+        c();
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void BenchTaskAlloc() {
+    const int rounds = 2000000;
+    volatile long sink = 0;
+    int fd = 7;
+    void* self = &fd;
+    long a = 1, b = 2, c = 3, d = 4;
+    char big[96] = { 0 };
+    auto small = [self, fd, &sink] { sink += fd + (self != nullptr); };
+    auto medium = [self, fd, a, b, c, d, &sink] { sink += fd + a + b + c + d + (self != nullptr); };
+    auto large = [big, &sink] { sink += big[0]; };
+    std::cout << "small  function " << BenchTaskOnce<std::function<void()>>(small, rounds)
+              << "us, task " << BenchTaskOnce<Task>(small, rounds) << "us" << std::endl;
+    std::cout << "medium function " << BenchTaskOnce<std::function<void()>>(medium, rounds)
+              << "us, task " << BenchTaskOnce<Task>(medium, rounds) << "us" << std::endl;
+    std::cout << "large  function " << BenchTaskOnce<std::function<void()>>(large, rounds)
+              << "us, task " << BenchTaskOnce<Task>(large, rounds) << "us" << std::endl;
+}
+
+/*4 个线程各放入 100000 行日志长度的字符串，一个消费者取走，比较每秒处理的行数。
+每行都先构造一个字符串（对应 Log 里 RetrieveAllToStr），push 决定是拷贝还是移动进队列，drain 返回一次取走的行数。*/
+template<class Push, class Drain>
+void BenchQueueOnce(const char* name, Push push, Drain drain) {
+    const int producers = 4, lines = 100000;
+    const std::string line(96, 'x');
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&] {
+        size_t got = 0;
+        while(got < static_cast<size_t>(producers) * lines) got += drain();
+    });
+    std::vector<std::thread> threads;
+    for(int p = 0; p < producers; p++) {
+        threads.emplace_back([&] {
+            for(int i = 0; i < lines; i++) {
+                std::string str(line);
+                push(str);
+            }
+        });
+    }
+    for(auto& t : threads) t.join();
+    consumer.join();
+    auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << producers * lines * 1000000LL / (cost ? cost : 1) << " lines/s" << std::endl;
+}
+
+void BenchLogQueue() {
+    {
+        BlockDeque<std::string> deq(1024);
+        BenchQueueOnce("BlockDeque copy + pop",
+            [&deq](std::string& str) { deq.push_back(static_cast<const std::string&>(str)); },
+            [&deq] { std::string str; return deq.pop(str) ? 1 : 0; });
+    }
+    {
+        BlockDeque<std::string> deq(1024);
+        std::vector<std::string> batch;
+        BenchQueueOnce("BlockDeque move + pop_all",
+            [&deq](std::string& str) { deq.push_back(std::move(str)); },
+            [&deq, &batch] { batch.clear(); deq.pop_all(batch); return batch.size(); });
+    }
+    {
+        MpmcQueue<std::string> deq(1024);
+        std::vector<std::string> batch;
+        BenchQueueOnce("MpmcQueue move + try_pop_n",
+            [&deq](std::string& str) { deq.push_back(std::move(str)); },
+            [&deq, &batch] {
+                batch.clear();
+                std::string str;
+                if(!deq.pop(str)) return size_t(0);
+                batch.push_back(std::move(str));
+                deq.try_pop_n(batch, 255);
+                return batch.size();
+            });
+    }
+}
+
+/*多个线程同时写 INFO 日志，只统计调用方花的时间：每条日志格式化进线程自己的暂存环，
+不加锁也不分配内存，吞吐应当随线程数增长，而不是被一把锁串行化。*/
+void BenchLogWrite() {
+    const int LINES = 200000;
+    Log::Instance()->init(1, "./testlog3", ".log", 1024);
+    for(int threads : {1, 2, 4}) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> writers;
+        for(int t = 0; t < threads; t++) {
+            writers.emplace_back([t] {
+                for(int i = 0; i < LINES; i++) {
+                    LOG_INFO("bench writer %d line %d ============= ", t, i);
+                }
+            });
+        }
+        for(auto& writer : writers) {
+            writer.join();
+        }
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "LOG_INFO " << threads << " threads: "
+                  << static_cast<long long>(threads * LINES / sec) << " lines/s" << std::endl;
+    }
+}
+
+/*同样两个线程写 INFO 日志，比较几种刷新策略下调用方的吞吐：只有 PER_LINE 每条都叫醒写线程。*/
+void BenchLogFlushPolicy() {
+    const int LINES = 200000;
+    struct Case { const char* name; Log::FLUSH_POLICY policy; int value; };
+    const Case cases[] = {
+        {"PER_LINE", Log::PER_LINE, 0},
+        {"INTERVAL 100ms", Log::INTERVAL, 100},
+        {"SIZE 256KB", Log::SIZE, 256 * 1024},
+        {"ON_LEVEL error", Log::ON_LEVEL, 3},
+    };
+    Log::Instance()->init(1, "./testlog4", ".log", 1024);
+    for(const Case& c : cases) {
+        Log::Instance()->SetFlushPolicy(c.policy, c.value);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> writers;
+        for(int t = 0; t < 2; t++) {
+            writers.emplace_back([t] {
+                for(int i = 0; i < LINES; i++) {
+                    LOG_INFO("bench writer %d line %d ============= ", t, i);
+                }
+            });
+        }
+        for(auto& writer : writers) {
+            writer.join();
+        }
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "flush " << c.name << ": " << static_cast<long long>(2 * LINES / sec) << " lines/s" << std::endl;
+    }
+}
+
 int main() {
     TestLog();
+    TestChainBuffer();
+    TestOutputQueue();
+    TestWorkStealDeque();
+    TestTask();
+    TestMpmcQueue();
+    TestLogRing();
+    TestBlockDeque();
+    BenchBufferReset();
+    BenchThreadPoolScaling();
+    BenchTaskAlloc();
+    BenchLogQueue();
+    BenchLogWrite();
+    BenchLogFlushPolicy();
     //TestThreadPool();
 }
\ No newline at end of file